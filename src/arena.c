@@ -0,0 +1,186 @@
+//========================================================//
+//  arena.c                                               //
+//  Single-mapping allocator for predictor tables         //
+//                                                        //
+//  Explicit huge pages come from MAP_HUGETLB and need a  //
+//  reserved pool; otherwise the mapping is aligned to    //
+//  2M and madvise()d for transparent huge pages. NUMA    //
+//  placement uses mbind(2) directly, no libnuma needed.  //
+//========================================================//
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include "arena.h"
+
+#define HUGE_PAGE  (2UL << 20)
+
+static size_t
+round_up(size_t v, size_t to)
+{
+  return (v + to - 1) / to * to;
+}
+
+// Transparent huge pages are only worth asking for if not disabled
+//
+static int
+thp_enabled()
+{
+  FILE *f = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+  if (!f) {
+    return 0;
+  }
+  char line[128] = "";
+  char *ok = fgets(line, sizeof(line), f);
+  fclose(f);
+  return ok && !strstr(line, "[never]");
+}
+
+// Map 'size' bytes aligned to a huge page boundary
+//
+static char *
+map_aligned(size_t size)
+{
+  char *raw = mmap(NULL, size + HUGE_PAGE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (raw == MAP_FAILED) {
+    return NULL;
+  }
+
+  // Trim the slack on both sides
+  char *base = (char *)round_up((uintptr_t)raw, HUGE_PAGE);
+  if (base > raw) {
+    munmap(raw, base - raw);
+  }
+  size_t tail = (raw + size + HUGE_PAGE) - (base + size);
+  if (tail) {
+    munmap(base + size, tail);
+  }
+  return base;
+}
+
+// Prefer the NUMA node this thread is running on
+//
+static int
+bind_local(char *base, size_t size)
+{
+  unsigned cpu, node;
+  if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0 || node >= 64) {
+    return -1;
+  }
+
+  unsigned long mask = 1UL << node;
+  if (syscall(SYS_mbind, base, size, MPOL_PREFERRED, &mask, 64, 0) != 0) {
+    return -1;
+  }
+  return node;
+}
+
+int
+arena_create(arena *a, const arena_request *requests, int count,
+             int pages, int numaLocal)
+{
+  memset(a, 0, sizeof(*a));
+  a->node = -1;
+  if (count > ARENA_MAX_TABLES) {
+    return -1;
+  }
+
+  // Lay the tables out back to back, each cache line aligned
+  size_t used = 0;
+  for (int i = 0; i < count; i++) {
+    a->tables[i].name = requests[i].name;
+    a->tables[i].offset = used;
+    a->tables[i].size = requests[i].size;
+    used = round_up(used + requests[i].size, ARENA_ALIGN);
+  }
+  a->numTables = count;
+  a->used = used;
+  if (used == 0) {
+    return 0;
+  }
+
+  // Small arenas would waste most of a huge page
+  size_t small = sysconf(_SC_PAGESIZE);
+  if (used < HUGE_PAGE) {
+    pages = ARENA_SMALL_PAGES;
+  }
+
+  if (pages == ARENA_EXPLICIT) {
+    a->size = round_up(used, HUGE_PAGE);
+    a->base = mmap(NULL, a->size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (a->base == MAP_FAILED) {
+      // No hugetlbfs pool reserved, settle for transparent ones
+      a->base = NULL;
+      pages = ARENA_TRANSPARENT;
+    } else {
+      a->pageSize = HUGE_PAGE;
+    }
+  }
+
+  if (!a->base && pages == ARENA_TRANSPARENT && thp_enabled()) {
+    a->size = round_up(used, HUGE_PAGE);
+    a->base = map_aligned(a->size);
+    if (a->base) {
+      madvise(a->base, a->size, MADV_HUGEPAGE);
+      a->pageSize = HUGE_PAGE;
+    }
+  }
+
+  if (!a->base) {
+    pages = ARENA_SMALL_PAGES;
+    a->size = round_up(used, small);
+    a->base = mmap(NULL, a->size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (a->base == MAP_FAILED) {
+      a->base = NULL;
+      return -1;
+    }
+    a->pageSize = small;
+  }
+  a->pages = pages;
+
+  // Nothing has been touched yet, so every page will land on the node
+  if (numaLocal) {
+    a->node = bind_local(a->base, a->size);
+  }
+
+  for (int i = 0; i < count; i++) {
+    *requests[i].ptr = a->base + a->tables[i].offset;
+  }
+  return 0;
+}
+
+void
+arena_report(FILE *out, const arena *a)
+{
+  static const char *backing[] = { "small pages", "transparent huge pages",
+                                   "explicit huge pages" };
+
+  fprintf(out, "Table layout: %zu bytes in one %zu byte mapping, %zuK pages "
+               "(%s)", a->used, a->size, a->pageSize / 1024,
+          backing[a->pages]);
+  if (a->node >= 0) {
+    fprintf(out, ", NUMA node %d", a->node);
+  }
+  fprintf(out, "\n");
+
+  for (int i = 0; i < a->numTables; i++) {
+    fprintf(out, "  %-12s offset %12zu  size %12zu\n", a->tables[i].name,
+            a->tables[i].offset, a->tables[i].size);
+  }
+}
+
+void
+arena_release(arena *a)
+{
+  if (a->base) {
+    munmap(a->base, a->size);
+  }
+  memset(a, 0, sizeof(*a));
+  a->node = -1;
+}
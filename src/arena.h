@@ -0,0 +1,66 @@
+//========================================================//
+//  arena.h                                               //
+//  Single-mapping allocator for predictor tables         //
+//                                                        //
+//  All tables of one predictor instance are carved out   //
+//  of one aligned mapping, backed by huge pages where    //
+//  possible, and released with a single munmap.          //
+//========================================================//
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+// Page backing requested for an arena
+#define ARENA_SMALL_PAGES     0   // Plain 4K pages
+#define ARENA_TRANSPARENT     1   // Ask for transparent huge pages (default)
+#define ARENA_EXPLICIT        2   // hugetlbfs pages, falling back to THP
+
+// Alignment of every table, one cache line
+#define ARENA_ALIGN           64
+
+#define ARENA_MAX_TABLES      8
+
+typedef struct {
+  const char *name;
+  size_t offset;
+  size_t size;
+} arena_table;
+
+typedef struct {
+  char *base;
+  size_t size;          // Bytes mapped
+  size_t used;
+  size_t pageSize;      // Page size backing the mapping
+  int pages;            // ARENA_* backing actually obtained
+  int node;             // NUMA node the memory is bound to, -1 if unbound
+  int numTables;
+  arena_table tables[ARENA_MAX_TABLES];
+} arena;
+
+// One table to carve: where to store its address and how big it is
+typedef struct {
+  const char *name;
+  void **ptr;
+  size_t size;
+} arena_request;
+
+// Map one arena big enough for every request, point each request's 'ptr'
+// at its zeroed, ARENA_ALIGN aligned table, and record the layout.
+// 'pages' is the ARENA_* backing to try; with 'numaLocal' the memory is
+// bound to the NUMA node of the calling thread. Returns 0 on success.
+//
+int arena_create(arena *a, const arena_request *requests, int count,
+                 int pages, int numaLocal);
+
+// Print table offsets and sizes and the page backing
+//
+void arena_report(FILE *out, const arena *a);
+
+// Unmap everything; the arena may be created again afterwards
+//
+void arena_release(arena *a);
+
+#endif
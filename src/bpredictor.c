@@ -0,0 +1,290 @@
+//========================================================//
+//  bpredictor.c                                          //
+//  Library front-end for the Branch Predictors           //
+//                                                        //
+//  Wraps the global-state predictors in predictor.c in   //
+//  handles. Each handle keeps its own snapshot of the    //
+//  predictor globals and it is swapped in on use, so     //
+//  any number of instances can coexist in one process.   //
+//  All instances share those globals, so the library as  //
+//  a whole must only be used from one thread at a time.  //
+//========================================================//
+#include <stdio.h>
+#include <string.h>
+#include "bpredictor.h"
+#include "predictor.h"
+
+struct bp_predictor {
+  uint64_t branches;
+  uint64_t mispredictions;
+  unsigned char state[];  // predictor_state_size() bytes
+};
+
+// The instance whose state currently lives in the predictor globals
+static bp_predictor *current = NULL;
+
+// Make 'bp' the instance the predictor globals belong to
+//
+static void
+activate(bp_predictor *bp)
+{
+  if (current == bp) {
+    return;
+  }
+  if (current) {
+    save_predictor_state(current->state);
+  }
+  load_predictor_state(bp->state);
+  current = bp;
+}
+
+// Check that a configuration describes something init_predictor() can build
+//
+static int
+valid_config(const bp_config *config)
+{
+  switch (config->type) {
+    case BP_STATIC:
+      return 1;
+    case BP_GSHARE:
+      return config->ghistoryBits > 0 && config->ghistoryBits <= 30;
+    case BP_TOURNAMENT:
+      return config->ghistoryBits > 0 && config->ghistoryBits <= 30 &&
+             config->lhistoryBits > 0 && config->lhistoryBits <= 30 &&
+             config->pcIndexBits > 0 && config->pcIndexBits <= 30;
+    case BP_CUSTOM:
+      return config->customType == 0 || config->customType == 1 ||
+             (config->customType == 2 && config->ghistoryBits >= 0 &&
+              config->ghistoryBits <= 256 && config->pcIndexBits >= 0 &&
+              config->pcIndexBits <= 24);
+    default:
+      return 0;
+  }
+}
+
+// Whether 'config' is recent enough to carry the bias filter fields
+//
+static int
+has_filter(const bp_config *config)
+{
+  return config->size >= offsetof(bp_config, filterConfidence) + sizeof(int);
+}
+
+unsigned
+bp_abi_version(void)
+{
+  return BP_ABI_VERSION;
+}
+
+bp_predictor *
+bp_create(unsigned abiVersion)
+{
+  if (abiVersion != BP_ABI_VERSION) {
+    return NULL;
+  }
+
+  // All-zero state is an unconfigured static predictor with no tables
+  bp_predictor *bp = calloc(1, sizeof(bp_predictor) + predictor_state_size());
+  return bp;
+}
+
+int
+bp_configure(bp_predictor *bp, const bp_config *config)
+{
+  if (!config || config->size < offsetof(bp_config, filterBits) ||
+      !valid_config(config)) {
+    return -1;
+  }
+  if (has_filter(config) &&
+      (config->filterBits < 0 || config->filterBits > 24 ||
+       config->filterConfidence < 0 || config->filterConfidence > 127)) {
+    return -1;
+  }
+
+  activate(bp);
+  clean_predictor();
+
+  bpType = config->type;
+  ghistoryBits = config->ghistoryBits;
+  lhistoryBits = config->lhistoryBits;
+  pcIndexBits = config->pcIndexBits;
+  customType = config->customType;
+  filterBits = 0;
+  filterConfidence = FILTER_CONFIDENCE;
+  if (has_filter(config)) {
+    filterBits = config->filterBits;
+    if (config->filterConfidence > 0) {
+      filterConfidence = config->filterConfidence;
+    }
+  }
+  if (init_predictor() != 0) {
+    // Fall back to the unconfigured static predictor bp_create() returns
+    clean_predictor();
+    bpType = STATIC;
+    filterBits = 0;
+    bp_reset_stats(bp);
+    return -1;
+  }
+
+  bp_reset_stats(bp);
+  return 0;
+}
+
+int
+bp_configure_string(bp_predictor *bp, const char *spec)
+{
+  bp_config config;
+  memset(&config, 0, sizeof(config));
+  config.size = sizeof(config);
+
+  // Accept the executable's "--" prefix as well
+  if (!strncmp(spec, "--", 2)) {
+    spec += 2;
+  }
+
+  if (!strcmp(spec, "static")) {
+    config.type = BP_STATIC;
+  } else if (!strncmp(spec, "gshare:", 7)) {
+    config.type = BP_GSHARE;
+    if (sscanf(spec+7, "%d", &config.ghistoryBits) != 1) {
+      return -1;
+    }
+  } else if (!strncmp(spec, "tournament:", 11)) {
+    config.type = BP_TOURNAMENT;
+    if (sscanf(spec+11, "%d:%d:%d", &config.ghistoryBits,
+               &config.lhistoryBits, &config.pcIndexBits) != 3) {
+      return -1;
+    }
+  } else if (!strncmp(spec, "custom:", 7)) {
+    config.type = BP_CUSTOM;
+    if (sscanf(spec+7, "%d:%d:%d", &config.customType, &config.ghistoryBits,
+               &config.pcIndexBits) < 1) {
+      return -1;
+    }
+  } else {
+    return -1;
+  }
+
+  return bp_configure(bp, &config);
+}
+
+uint8_t
+bp_predict(bp_predictor *bp, uint32_t pc)
+{
+  activate(bp);
+  return make_prediction(pc);
+}
+
+void
+bp_train(bp_predictor *bp, uint32_t pc, uint8_t outcome)
+{
+  activate(bp);
+  train_predictor(pc, outcome);
+}
+
+size_t
+bp_predict_batch(bp_predictor *bp, const uint32_t *pcs,
+                 const uint8_t *outcomes, size_t count, uint8_t *predictions)
+{
+  activate(bp);
+
+  size_t mispredictions = 0;
+  for (size_t i = 0; i < count; i++) {
+    uint8_t prediction = make_prediction(pcs[i]);
+    if (prediction != outcomes[i]) {
+      mispredictions++;
+    }
+    if (predictions) {
+      predictions[i] = prediction;
+    }
+    train_predictor(pcs[i], outcomes[i]);
+  }
+
+  bp->branches += count;
+  bp->mispredictions += mispredictions;
+  return mispredictions;
+}
+
+uint64_t
+bp_replay(bp_predictor *bp, bp_fetch_fn fetch, void *ctx)
+{
+  activate(bp);
+
+  uint64_t replayed = 0;
+  bp_span span;
+  memset(&span, 0, sizeof(span));
+
+  // Walk the caller's buffers in place, one window at a time
+  while (fetch(ctx, &span)) {
+    const char *pcp = span.pc;
+    const char *outp = span.outcome;
+    uint64_t mispredictions = 0;
+
+    for (size_t i = 0; i < span.count; i++) {
+      uint32_t pc;
+      memcpy(&pc, pcp, sizeof(pc));
+      uint8_t outcome = *(const uint8_t *)outp;
+
+      if (make_prediction(pc) != outcome) {
+        mispredictions++;
+      }
+      train_predictor(pc, outcome);
+
+      pcp += span.pcStride;
+      outp += span.outcomeStride;
+    }
+
+    bp->branches += span.count;
+    bp->mispredictions += mispredictions;
+    replayed += span.count;
+
+    // The callback may itself drive another instance
+    activate(bp);
+  }
+
+  return replayed;
+}
+
+void
+bp_get_stats(const bp_predictor *bp, bp_stats *stats)
+{
+  // Older callers pass a shorter structure; fill in what it has room for
+  if (!stats || stats->size < offsetof(bp_stats, mispredictions) +
+                              sizeof(uint64_t)) {
+    return;
+  }
+  stats->branches = bp->branches;
+  stats->mispredictions = bp->mispredictions;
+
+  if (stats->size >= offsetof(bp_stats, filterMisses) + sizeof(uint64_t)) {
+    // The filter counts live with the rest of the instance's state; swapping
+    // it in leaves what the instance predicts untouched
+    activate((bp_predictor *)bp);
+    filter_stats(&stats->filtered, &stats->filterMisses);
+  }
+}
+
+void
+bp_reset_stats(bp_predictor *bp)
+{
+  bp->branches = 0;
+  bp->mispredictions = 0;
+
+  activate(bp);
+  filter_clear_stats();
+}
+
+void
+bp_destroy(bp_predictor *bp)
+{
+  if (!bp) {
+    return;
+  }
+
+  activate(bp);
+  clean_predictor();
+
+  // The globals now describe nothing; don't save them into a freed handle
+  current = NULL;
+  free(bp);
+}
@@ -0,0 +1,123 @@
+//========================================================//
+//  bpredictor.h                                          //
+//  Public C interface of libbpredictor                   //
+//                                                        //
+//  Lets simulators embed the predictors from predictor.c //
+//  without copying the source or touching its globals.   //
+//========================================================//
+
+#ifndef BPREDICTOR_H
+#define BPREDICTOR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Bumped only for incompatible changes. New struct fields are appended and
+// detected through the struct's 'size', so they keep the version as is.
+// Callers pass the version they were compiled against to bp_create().
+#define BP_ABI_VERSION  1
+
+// Predictor types accepted in bp_config.type (same values as predictor.h)
+#define BP_STATIC       0
+#define BP_GSHARE       1
+#define BP_TOURNAMENT   2
+#define BP_CUSTOM       3
+
+// Opaque handle to one predictor instance. Every instance runs on the same
+// process-wide predictor state, so calls into the library (on any instance)
+// must not overlap; use it from one thread or serialize the calls.
+typedef struct bp_predictor bp_predictor;
+
+// Predictor configuration. 'size' must be set to sizeof(bp_config) so that
+// later versions can append fields without breaking older callers. Callers
+// built before the filter fields were added get no filter.
+typedef struct {
+  uint32_t size;
+  int type;           // BP_STATIC, BP_GSHARE, BP_TOURNAMENT or BP_CUSTOM
+  int ghistoryBits;   // Global history bits (gshare, tournament), path
+                      // length (custom 2, 0 = default)
+  int lhistoryBits;   // Local history bits (tournament)
+  int pcIndexBits;    // PC index bits (tournament, custom 2)
+  int customType;     // Custom predictor selector (custom)
+  int filterBits;     // Bias filter index bits, 0 = no filter
+  int filterConfidence; // Run length that settles a branch (0 = default)
+} bp_config;
+
+// Running statistics of an instance. Set 'size' to sizeof(bp_stats) before
+// bp_get_stats(); fields beyond the caller's 'size' are left alone.
+typedef struct {
+  uint32_t size;
+  uint64_t branches;
+  uint64_t mispredictions;
+  uint64_t filtered;      // Branches the bias filter answered by itself
+  uint64_t filterMisses;  // How many of those it mispredicted
+} bp_stats;
+
+// A window into caller-owned branch records. Records are read in place:
+// record i has its PC at (char *)pc + i * pcStride and its outcome byte at
+// (char *)outcome + i * outcomeStride, which covers both separate arrays
+// and arrays of structs.
+typedef struct {
+  const void *pc;         // First uint32_t PC
+  size_t pcStride;        // Bytes between consecutive PCs
+  const void *outcome;    // First uint8_t outcome (NOTTAKEN = 0, TAKEN = 1)
+  size_t outcomeStride;   // Bytes between consecutive outcomes
+  size_t count;           // Number of records in the window
+} bp_span;
+
+// Replay callback. Fill in 'span' with the next window of records and
+// return non-zero, or return 0 once the trace is exhausted. The memory must
+// stay valid until the next call.
+typedef int (*bp_fetch_fn)(void *ctx, bp_span *span);
+
+// ABI version the library was built with
+unsigned bp_abi_version(void);
+
+// Create an unconfigured (static) predictor. Returns NULL if 'abiVersion'
+// does not match the library or on allocation failure.
+bp_predictor *bp_create(unsigned abiVersion);
+
+// (Re)configure an instance and reset its tables and statistics.
+// Returns 0 on success and -1 on an invalid configuration or if the tables
+// cannot be allocated; in the latter case the instance is left as an
+// unconfigured static predictor.
+int bp_configure(bp_predictor *bp, const bp_config *config);
+
+// Same as bp_configure() but takes the command line spelling used by the
+// predictor executable, e.g. "gshare:13", "tournament:9:10:10" or
+// "custom:2:32:9".
+int bp_configure_string(bp_predictor *bp, const char *spec);
+
+// Predict the branch at 'pc'. Does not update any state.
+uint8_t bp_predict(bp_predictor *bp, uint32_t pc);
+
+// Train with the resolved outcome of the branch last predicted at 'pc'
+void bp_train(bp_predictor *bp, uint32_t pc, uint8_t outcome);
+
+// Predict and train 'count' branches in order, counting mispredictions in
+// the instance statistics. 'predictions' may be NULL. Returns the number of
+// mispredictions within this batch.
+size_t bp_predict_batch(bp_predictor *bp, const uint32_t *pcs,
+                        const uint8_t *outcomes, size_t count,
+                        uint8_t *predictions);
+
+// Predict and train every record handed out by 'fetch' until it returns 0.
+// Returns the number of branches replayed.
+uint64_t bp_replay(bp_predictor *bp, bp_fetch_fn fetch, void *ctx);
+
+// Copy out / clear the running statistics
+void bp_get_stats(const bp_predictor *bp, bp_stats *stats);
+void bp_reset_stats(bp_predictor *bp);
+
+// Free an instance and all of its tables
+void bp_destroy(bp_predictor *bp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
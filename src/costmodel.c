@@ -0,0 +1,182 @@
+//========================================================//
+//  costmodel.c                                           //
+//  Hardware cost estimates for predictor configurations  //
+//                                                        //
+//  Tables are split into subarrays of at most 256 rows   //
+//  by 256 columns, each read through decoder, wordline,  //
+//  bitline and sense amp, and joined by an H-tree whose  //
+//  wire delay grows with the square root of the area.    //
+//  Constants are for a generic 22nm process and only     //
+//  meant to rank configurations, not to sign off on one. //
+//========================================================//
+#include <math.h>
+#include "costmodel.h"
+
+// Subarray geometry
+#define MAX_ROWS        256
+#define MAX_COLS        256
+
+// Delays in ps
+#define DECODE_BASE     20.0    // Predecode and wordline driver
+#define DECODE_PER_BIT  12.0    // Per address bit decoded
+#define WORDLINE_PER_COL 0.15
+#define BITLINE_PER_ROW  0.30
+#define SENSE           25.0
+#define MUX_PER_LEVEL   10.0    // Column mux, per level of 2:1 selection
+#define WIRE_PER_MM     90.0    // Repeated global wire
+#define GATE            12.0    // One simple gate (index XOR, mux level)
+#define ADDER_BASE      30.0    // Carry-lookahead adder, plus per bit level
+#define ADDER_PER_LEVEL 10.0
+
+// Area
+#define CELL_UM2        0.10    // 6T SRAM cell
+#define PERIPHERY       0.35    // Decoders, sense amps, drivers per subarray
+#define ADDER_UM2_BIT   6.0
+
+// Energy in pJ
+#define BITLINE_PJ_CELL 0.00005 // Per cell on the bitlines of an active row
+#define SENSE_PJ_BIT    0.002
+#define WIRE_PJ_BIT_MM  0.08
+#define ADDER_PJ_BIT    0.01
+
+static int
+log2_ceil(uint64_t v)
+{
+  int n = 0;
+  while (((uint64_t)1 << n) < v) {
+    n++;
+  }
+  return n;
+}
+
+void
+cost_add_table(cost_design *d, const char *name, uint64_t entries, int width,
+               int stage)
+{
+  if (d->numTables == COST_MAX_TABLES || entries == 0 || width <= 0) {
+    return;
+  }
+  cost_table *t = &d->tables[d->numTables++];
+  t->name = name;
+  t->entries = entries;
+  t->width = width;
+  t->stage = stage;
+}
+
+void
+cost_table_estimate(const cost_table *t, cost_estimate *e)
+{
+  // Roughly square subarrays; an entry wider than a subarray row is spread
+  // over several subarrays read side by side
+  uint64_t bits = t->entries * t->width;
+  int rowBits = (log2_ceil(bits) + 1) / 2;
+  uint64_t cols = (uint64_t)1 << rowBits;
+  if (cols < (uint64_t)t->width) {
+    cols = t->width;
+  }
+  if (cols > MAX_COLS) {
+    cols = MAX_COLS;
+  }
+  uint64_t rows = (bits + cols - 1) / cols;
+  uint64_t subarrays = 1;
+  if (rows > MAX_ROWS) {
+    subarrays = (rows + MAX_ROWS - 1) / MAX_ROWS;
+    rows = MAX_ROWS;
+  }
+  uint64_t active = (t->width + cols - 1) / cols;
+
+  e->area = subarrays * rows * cols * CELL_UM2 * (1 + PERIPHERY) / 1e6;
+
+  // Entries sharing a row are picked out by the column mux
+  int muxLevels = cols > (uint64_t)t->width ? log2_ceil(cols / t->width) : 0;
+  double wire = subarrays > 1 ? WIRE_PER_MM * sqrt(e->area) : 0;
+  e->latency = DECODE_BASE + DECODE_PER_BIT * log2_ceil(rows) +
+               WORDLINE_PER_COL * cols + BITLINE_PER_ROW * rows + SENSE +
+               MUX_PER_LEVEL * muxLevels + wire;
+
+  e->energy = active * (rows * cols * BITLINE_PJ_CELL) +
+              t->width * SENSE_PJ_BIT +
+              (subarrays > 1 ? t->width * WIRE_PJ_BIT_MM * sqrt(e->area) : 0);
+}
+
+void
+cost_design_estimate(const cost_design *d, cost_estimate *e)
+{
+  e->latency = 0;
+  e->area = 0;
+  e->energy = 0;
+  if (d->numTables == 0) {
+    return;
+  }
+
+  // Index hashing (one XOR), then the slowest table of every stage
+  double path = GATE;
+  for (int stage = 0; ; stage++) {
+    double slowest = -1;
+    for (int i = 0; i < d->numTables; i++) {
+      if (d->tables[i].stage != stage) {
+        continue;
+      }
+      cost_estimate t;
+      cost_table_estimate(&d->tables[i], &t);
+      e->area += t.area;
+      e->energy += t.energy;
+      if (t.latency > slowest) {
+        slowest = t.latency;
+      }
+    }
+    if (slowest < 0) {
+      break;
+    }
+    path += slowest;
+  }
+
+  // Tree of two-input adders, growing one bit per level
+  if (d->adderInputs > 1) {
+    int levels = log2_ceil(d->adderInputs);
+    for (int l = 0; l < levels; l++) {
+      path += ADDER_BASE + ADDER_PER_LEVEL * log2_ceil(d->adderWidth + l);
+    }
+    int adderBits = (d->adderInputs - 1) * (d->adderWidth + levels / 2);
+    e->area += adderBits * ADDER_UM2_BIT / 1e6;
+    e->energy += adderBits * ADDER_PJ_BIT;
+  }
+
+  if (d->muxInputs > 1) {
+    path += GATE * log2_ceil(d->muxInputs);
+  }
+  e->latency = path;
+}
+
+void
+cost_report(FILE *out, const cost_design *d, double ghz)
+{
+  fprintf(out, "Hardware cost estimate (22nm model, %.2f GHz):\n", ghz);
+  if (d->numTables == 0) {
+    fprintf(out, "  no tables\n");
+    return;
+  }
+
+  fprintf(out, "  %-12s %10s %5s %5s %11s %9s %8s\n", "table", "entries",
+          "bits", "stage", "latency ps", "area mm2", "read pJ");
+  for (int i = 0; i < d->numTables; i++) {
+    const cost_table *t = &d->tables[i];
+    cost_estimate e;
+    cost_table_estimate(t, &e);
+    fprintf(out, "  %-12s %10llu %5d %5d %11.1f %9.4f %8.2f\n", t->name,
+            (unsigned long long)t->entries, t->width, t->stage, e.latency,
+            e.area, e.energy);
+  }
+  if (d->adderInputs > 1) {
+    fprintf(out, "  adder tree: %d inputs of %d bits, depth %d\n",
+            d->adderInputs, d->adderWidth, log2_ceil(d->adderInputs));
+  }
+
+  cost_estimate total;
+  cost_design_estimate(d, &total);
+  int cycles = (int)ceil(total.latency * ghz / 1000);
+  fprintf(out, "  Prediction path: %.1f ps, %d cycle%s%s, %.4f mm2, "
+               "%.2f pJ per prediction\n", total.latency, cycles,
+          cycles == 1 ? "" : "s", cycles <= 1 ? " (fits)" : "", total.area,
+          total.energy);
+}
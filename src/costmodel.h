@@ -0,0 +1,61 @@
+//========================================================//
+//  costmodel.h                                           //
+//  Hardware cost estimates for predictor configurations  //
+//                                                        //
+//  A small self-contained SRAM model in the spirit of    //
+//  CACTI: access latency, area and read energy of every  //
+//  table, plus the logic after the reads, so that a      //
+//  configuration can be checked against a cycle budget.  //
+//========================================================//
+
+#ifndef COSTMODEL_H
+#define COSTMODEL_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define COST_MAX_TABLES  8
+
+// One table as hardware would build it
+typedef struct {
+  const char *name;
+  uint64_t entries;
+  int width;        // Bits per entry, i.e. bits read per lookup
+  int stage;        // Tables of stage s+1 are indexed by a stage s read
+} cost_table;
+
+// Everything on the path from PC to prediction
+typedef struct {
+  cost_table tables[COST_MAX_TABLES];
+  int numTables;
+  int adderInputs;  // Values summed after the reads (perceptrons), 0 = none
+  int adderWidth;   // Bits of each summed value
+  int muxInputs;    // Predictions chosen between at the end, 0 or 1 = none
+} cost_design;
+
+// Estimates for one table or a whole design
+typedef struct {
+  double latency;   // ps
+  double area;      // mm^2
+  double energy;    // pJ per lookup
+} cost_estimate;
+
+// Add a table to 'd'
+//
+void cost_add_table(cost_design *d, const char *name, uint64_t entries,
+                    int width, int stage);
+
+// Estimate one table
+//
+void cost_table_estimate(const cost_table *t, cost_estimate *e);
+
+// Estimate the whole prediction path: the slowest chain of dependent
+// table reads plus the adder tree and the final selection
+//
+void cost_design_estimate(const cost_design *d, cost_estimate *e);
+
+// Print every table and the totals, with the latency in cycles at 'ghz'
+//
+void cost_report(FILE *out, const cost_design *d, double ghz);
+
+#endif
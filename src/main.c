@@ -8,11 +8,60 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "predictor.h"
+#include "perfcount.h"
+#include "parallel.h"
+#include "resultcache.h"
+#include "sweep.h"
+#include "trace.h"
+#include "traceindex.h"
 
-FILE *stream;
-char *buf = NULL;
-size_t len = 0;
+trace *input;
+char *tracePath = NULL;
+
+// Sidecar index of the trace, if one was found
+trace_index idx;
+int haveIndex = 0;
+
+// Sample hardware counters on every perfPeriod-th branch (0 = off)
+unsigned perfPeriod = 0;
+
+// Lookahead prefetching: how many branches ahead to prefetch (0 = off),
+// the read-ahead ring, and the global history as of the newest read branch
+unsigned prefetchDistance = 0;
+uint32_t *aheadPcs;
+uint8_t *aheadOutcomes;
+unsigned aheadHead = 0;
+unsigned aheadCount = 0;
+unsigned aheadHistory = 0;
+uint64_t prefetched = 0;     // Table cache lines prefetched
+uint64_t touchedLines = 0;   // Table cache lines the simulated branches used
+
+// Print the predictor table layout after the run
+int printLayout = 0;
+
+// Index building / seeking / progress
+int buildIndex = 0;
+unsigned long long indexInterval = INDEX_INTERVAL;
+unsigned long long startBranch = 0;
+int progress = 0;
+
+// Approximate parallel mode: number of chunks (0 = off), the warmup each
+// chunk replays from its predecessor, and whether to check against serial
+int parallelChunks = 0;
+unsigned long long parallelWarmup = 100000;
+int parallelCheck = 0;
+
+// Sweep every gshare size up to this many history bits (0 = off)
+int sweepBits = 0;
+
+// Clock in GHz to report the hardware cost model against (0 = off)
+double costGhz = 0;
+
+// Reuse results of identical earlier runs
+int useCache = 1;
+int cacheStats = 0;
 
 // Print out the Usage information to stderr
 //
@@ -21,14 +70,57 @@ usage()
 {
   fprintf(stderr,"Usage: predictor <options> [<trace>]\n");
   fprintf(stderr,"       bunzip -kc trace.bz2 | predictor <options>\n");
+  fprintf(stderr,"       (.bz2 traces can also be named directly)\n");
   fprintf(stderr," Options:\n");
   fprintf(stderr," --help       Print this message\n");
   fprintf(stderr," --verbose    Print predictions on stdout\n");
+  fprintf(stderr," --perf[:<period>]\n"
+                 "              Count cycles, instructions, LLC and dTLB misses\n"
+                 "              per loop phase on every <period>-th branch (64)\n");
+  fprintf(stderr," --prefetch:<distance>\n"
+                 "              Read the trace <distance> branches ahead and\n"
+                 "              prefetch the table lines they will use\n");
+  fprintf(stderr," --hugepages:<none|thp|explicit>\n"
+                 "              Page backing for the predictor tables (thp)\n");
+  fprintf(stderr," --numa       Keep the tables on the local NUMA node\n");
+  fprintf(stderr," --filter[:<# index>[:<run>]]\n"
+                 "              Answer branches that went the same way <run>\n"
+                 "              times in a row (16) from a 2^<# index> entry\n"
+                 "              bias filter (10) in front of the predictor\n");
+  fprintf(stderr," --delay:<n>  Hold table updates back and apply them in\n"
+                 "              batches every <n> branches; predictions in\n"
+                 "              between see the stale tables\n");
+  fprintf(stderr," --layout     Print the predictor table layout\n");
+  fprintf(stderr," --cost[:<GHz>]\n"
+                 "              Estimate latency, area and energy of the tables\n"
+                 "              and check the cycle budget at <GHz> (3.0)\n");
+  fprintf(stderr," --threads[:<n>]\n"
+                 "              Decode .bz2 traces on <n> threads (all cores)\n");
+  fprintf(stderr," --index[:<interval>]\n"
+                 "              Write <trace>.idx with the trace length, PC\n"
+                 "              footprint and a seek point every <interval>\n"
+                 "              branches (65536), then exit\n");
+  fprintf(stderr," --start:<n>  Skip the first <n> branches (fast with an index)\n");
+  fprintf(stderr," --progress   Report progress on stderr (needs an index)\n");
+  fprintf(stderr," --parallel:<chunks>[:<warmup>]\n"
+                 "              Simulate the trace as <chunks> concurrent pieces,\n"
+                 "              each warmed up on <warmup> branches (100000)\n");
+  fprintf(stderr," --check-serial\n"
+                 "              With --parallel, also run the exact serial\n"
+                 "              simulation and report the deviation\n");
+  fprintf(stderr," --sweep[:<# ghistory>]\n"
+                 "              Simulate gshare (and the tournament's global\n"
+                 "              table) with 1..<# ghistory> bits in one pass (24)\n");
+  fprintf(stderr," --no-cache   Always simulate, don't use or update the\n"
+                 "              result cache ($BP_CACHE_DIR, ~/.cache/bpredictor)\n");
+  fprintf(stderr," --cache-stats\n"
+                 "              Print the size and hit rate of the result cache\n");
   fprintf(stderr," --<type>     Branch prediction scheme:\n");
   fprintf(stderr,"    static\n"
                  "    gshare:<# ghistory>\n"
                  "    tournament:<# ghistory>:<# lhistory>:<# index>\n"
-                 "    custom:<# customType>\n");
+                 "    custom:<# customType>\n"
+                 "    custom:2[:<# path length>[:<# index>]]\n");
 }
 
 // Process an option and update the predictor
@@ -49,10 +141,78 @@ handle_option(char *arg)
     sscanf(arg+13,"%d:%d:%d", &ghistoryBits, &lhistoryBits, &pcIndexBits);
   } else if (!strncmp(arg,"--custom:",9)) {
     bpType = CUSTOM;
-    // Decide which custom predictor you want. 0 = tournament-based, 1 = perceptron
-    sscanf(arg+9,"%d", &customType);
+    // Decide which custom predictor you want. 0 = tournament-based, 1 = perceptron,
+    // 2 = path-based neural (optionally with its path length and index bits)
+    sscanf(arg+9,"%d:%d:%d", &customType, &ghistoryBits, &pcIndexBits);
   } else if (!strcmp(arg,"--verbose")) {
     verbose = 1;
+  } else if (!strcmp(arg,"--perf")) {
+    perfPeriod = 64;
+  } else if (!strncmp(arg,"--perf:",7)) {
+    sscanf(arg+7,"%u", &perfPeriod);
+  } else if (!strncmp(arg,"--prefetch:",11)) {
+    sscanf(arg+11,"%u", &prefetchDistance);
+  } else if (!strcmp(arg,"--hugepages:none")) {
+    tablePages = ARENA_SMALL_PAGES;
+  } else if (!strcmp(arg,"--hugepages:thp")) {
+    tablePages = ARENA_TRANSPARENT;
+  } else if (!strcmp(arg,"--hugepages:explicit")) {
+    tablePages = ARENA_EXPLICIT;
+  } else if (!strcmp(arg,"--numa")) {
+    tableNuma = 1;
+  } else if (!strncmp(arg,"--filter",8) && (arg[8] == ':' || !arg[8])) {
+    filterBits = 10;
+    if (arg[8]) {
+      sscanf(arg+9,"%d:%d", &filterBits, &filterConfidence);
+    }
+    if (filterBits < 1 || filterBits > 24 ||
+        filterConfidence < 1 || filterConfidence > 127) {
+      return 0;
+    }
+  } else if (!strcmp(arg,"--sweep")) {
+    sweepBits = 24;
+  } else if (!strncmp(arg,"--sweep:",8)) {
+    sscanf(arg+8,"%d", &sweepBits);
+    if (sweepBits < 1 || sweepBits > SWEEP_MAX_BITS) {
+      return 0;
+    }
+  } else if (!strcmp(arg,"--cost")) {
+    costGhz = 3.0;
+  } else if (!strncmp(arg,"--cost:",7)) {
+    sscanf(arg+7,"%lf", &costGhz);
+    if (costGhz <= 0) {
+      return 0;
+    }
+  } else if (!strcmp(arg,"--no-cache")) {
+    useCache = 0;
+  } else if (!strcmp(arg,"--cache-stats")) {
+    cacheStats = 1;
+  } else if (!strncmp(arg,"--delay:",8)) {
+    if (sscanf(arg+8,"%d", &updateDelay) != 1 || updateDelay < 0) {
+      return 0;
+    }
+  } else if (!strcmp(arg,"--layout")) {
+    printLayout = 1;
+  } else if (!strcmp(arg,"--threads")) {
+    trace_set_threads(sysconf(_SC_NPROCESSORS_ONLN));
+  } else if (!strncmp(arg,"--threads:",10)) {
+    trace_set_threads(atoi(arg+10));
+  } else if (!strcmp(arg,"--index")) {
+    buildIndex = 1;
+  } else if (!strncmp(arg,"--index:",8)) {
+    buildIndex = 1;
+    sscanf(arg+8,"%llu", &indexInterval);
+  } else if (!strncmp(arg,"--start:",8)) {
+    sscanf(arg+8,"%llu", &startBranch);
+  } else if (!strcmp(arg,"--progress")) {
+    progress = 1;
+  } else if (!strncmp(arg,"--parallel:",11)) {
+    sscanf(arg+11,"%d:%llu", &parallelChunks, &parallelWarmup);
+    if (parallelChunks < 1) {
+      return 0;
+    }
+  } else if (!strcmp(arg,"--check-serial")) {
+    parallelCheck = 1;
   } else {
     return 0;
   }
@@ -68,17 +228,121 @@ handle_option(char *arg)
 int
 read_branch(uint32_t *pc, uint8_t *outcome)
 {
-  if (getline(&buf, &len, stream) == -1) {
-    return 0;
+  if (!prefetchDistance) {
+    return trace_read(input, pc, outcome);
   }
 
-  uint32_t tmp;
-  sscanf(buf,"0x%x %d\n",pc,&tmp);
-  *outcome = tmp;
+  // Keep the ring full. Each branch entering it is prefetched with the
+  // history it will see, which is already known from the branches ahead
+  // of it in the ring.
+  while (aheadCount <= prefetchDistance) {
+    unsigned tail = (aheadHead + aheadCount) % (prefetchDistance + 1);
+    if (!trace_read(input, &aheadPcs[tail], &aheadOutcomes[tail])) {
+      break;
+    }
+    prefetched += prefetch_predictor(aheadPcs[tail], aheadHistory);
+    aheadHistory = (aheadHistory << 1) | aheadOutcomes[tail];
+    aheadCount++;
+  }
 
+  if (aheadCount == 0) {
+    return 0;
+  }
+  *pc = aheadPcs[aheadHead];
+  *outcome = aheadOutcomes[aheadHead];
+  touchedLines += predictor_lines(*pc, *outcome);
+  aheadHead = (aheadHead + 1) % (prefetchDistance + 1);
+  aheadCount--;
   return 1;
 }
 
+// Reads the whole trace into memory for the parallel simulation
+//
+// Returns the number of branches read
+//
+uint64_t
+load_trace(uint32_t **pcs, uint8_t **outcomes)
+{
+  uint64_t count = 0;
+  uint64_t capacity = 1 << 20;
+  if (haveIndex && idx.branches > startBranch) {
+    capacity = idx.branches - startBranch;
+  }
+  *pcs = malloc(capacity * sizeof(uint32_t));
+  *outcomes = malloc(capacity * sizeof(uint8_t));
+
+  uint32_t pc;
+  uint8_t outcome;
+  while (trace_read(input, &pc, &outcome)) {
+    if (count == capacity) {
+      capacity *= 2;
+      *pcs = realloc(*pcs, capacity * sizeof(uint32_t));
+      *outcomes = realloc(*outcomes, capacity * sizeof(uint8_t));
+    }
+    (*pcs)[count] = pc;
+    (*outcomes)[count] = outcome;
+    count++;
+  }
+
+  return count;
+}
+
+// Print the statistics of a run, simulated or from the cache
+//
+void
+print_results(const cached_result *r)
+{
+  printf("Branches:        %10llu\n", (unsigned long long)r->branches);
+  printf("Incorrect:       %10llu\n", (unsigned long long)r->mispredictions);
+  float mispredict_rate = 100*((double)r->mispredictions / (double)r->branches);
+  printf("Misprediction Rate: %7.3f\n", mispredict_rate);
+  if (filterBits && !parallelChunks) {
+    printf("Filtered:        %10llu (%.1f%%), %llu mispredicted\n",
+           (unsigned long long)r->filtered,
+           r->branches ? 100.0 * r->filtered / r->branches : 0.0,
+           (unsigned long long)r->filterMisses);
+  }
+}
+
+// Print the hardware cost of the configured predictor, building it first
+// if nothing else has
+//
+void
+print_cost(int build)
+{
+  cost_design design;
+  if (build && init_predictor() != 0) {
+    fprintf(stderr, "Cannot allocate the predictor tables\n");
+    exit(1);
+  }
+  describe_predictor(&design);
+  cost_report(stdout, &design, costGhz);
+  if (build) {
+    clean_predictor();
+  }
+}
+
+// Key of this run in the result cache: the trace and every option that can
+// change the statistics. Returns 0 if the run can be cached.
+//
+int
+cache_key(uint64_t *key)
+{
+  // Runs that report more than the statistics have to be simulated
+  if (!useCache || !tracePath || verbose || perfPeriod || prefetchDistance ||
+      printLayout || parallelCheck) {
+    return -1;
+  }
+
+  char config[256];
+  snprintf(config, sizeof(config), "type %d ghist %d lhist %d index %d "
+           "custom %d filter %d:%d delay %d start %llu parallel %d:%llu",
+           bpType, ghistoryBits, lhistoryBits, pcIndexBits, customType,
+           filterBits, filterBits ? filterConfidence : 0, updateDelay,
+           startBranch, parallelChunks, parallelChunks ? parallelWarmup : 0);
+  return result_cache_key(tracePath, config, key);
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -87,7 +351,6 @@ main(int argc, char *argv[])
   email = "ammunson@ucsd.edu";
   
   // Set defaults
-  stream = stdin;
   bpType = STATIC;
   verbose = 0;
 
@@ -104,24 +367,195 @@ main(int argc, char *argv[])
       }
     } else {
       // Use as input file
-      stream = fopen(argv[i], "r");
+      tracePath = argv[i];
+    }
+  }
+
+  // Filtered branches never reach the global history, so the ring could
+  // not tell which entries the backing predictor will look up
+  if (prefetchDistance && filterBits) {
+    fprintf(stderr, "--prefetch cannot be combined with --filter\n");
+    exit(1);
+  }
+
+  // A sweep runs plain gshare tables of its own, none of these apply to it
+  if (sweepBits) {
+    const char *other = filterBits ? "--filter" :
+                        updateDelay ? "--delay" :
+                        prefetchDistance ? "--prefetch" :
+                        parallelChunks ? "--parallel" :
+                        perfPeriod ? "--perf" :
+                        verbose ? "--verbose" :
+                        printLayout ? "--layout" : NULL;
+    if (other) {
+      fprintf(stderr, "%s cannot be combined with --sweep\n", other);
+      exit(1);
     }
   }
 
+  if (cacheStats) {
+    result_cache_report(stdout);
+    return 0;
+  }
+
+  // An identical run has been simulated before
+  uint64_t key;
+  int cacheable = !buildIndex && !sweepBits && cache_key(&key) == 0;
+  cached_result result;
+  if (cacheable && result_cache_get(key, &result)) {
+    print_results(&result);
+    if (costGhz) {
+      print_cost(1);
+    }
+    return 0;
+  }
+
+  if (buildIndex) {
+    if (!tracePath || indexInterval == 0 ||
+        trace_index_build(tracePath, indexInterval, &idx) != 0 ||
+        trace_index_write(tracePath, &idx) != 0) {
+      fprintf(stderr, "--index needs a readable trace file\n");
+      exit(1);
+    }
+    trace_index_print(stdout, &idx);
+    trace_index_free(&idx);
+    return 0;
+  }
+
+  input = trace_open(tracePath);
+  if (!input) {
+    exit(1);
+  }
+  haveIndex = tracePath && trace_index_load(tracePath, &idx) == 0;
+
+  // Jump to the first branch to simulate
+  if (startBranch && haveIndex) {
+    if (trace_index_seek(input, &idx, startBranch) != 0) {
+      fprintf(stderr, "Cannot seek to branch %llu\n", startBranch);
+      exit(1);
+    }
+  } else if (startBranch) {
+    uint32_t pc;
+    uint8_t outcome;
+    for (unsigned long long i = 0; i < startBranch; i++) {
+      if (!trace_read(input, &pc, &outcome)) {
+        break;
+      }
+    }
+  }
+  if (progress && !haveIndex) {
+    fprintf(stderr, "--progress needs an index, run with --index first\n");
+    progress = 0;
+  }
+  if (progress && startBranch >= idx.branches) {
+    progress = 0;
+  }
+
+  if (sweepBits) {
+    sweep s;
+    if (sweep_init(&s, sweepBits, tablePages) != 0) {
+      fprintf(stderr, "Cannot allocate the sweep tables\n");
+      exit(1);
+    }
+    uint32_t pc;
+    uint8_t outcome;
+    while (trace_read(input, &pc, &outcome)) {
+      sweep_branch(&s, pc, outcome);
+    }
+    sweep_report(stdout, &s, costGhz);
+    sweep_free(&s);
+    trace_close(input);
+    trace_index_free(&idx);
+    return 0;
+  }
+
+  if (parallelChunks) {
+    if (verbose) {
+      fprintf(stderr, "--verbose cannot be combined with --parallel\n");
+      exit(1);
+    }
+    // The workers replay from memory, there is nothing to prefetch for
+    if (prefetchDistance) {
+      fprintf(stderr, "--prefetch cannot be combined with --parallel\n");
+      exit(1);
+    }
+
+    uint32_t *pcs;
+    uint8_t *outcomes;
+    uint64_t count = load_trace(&pcs, &outcomes);
+
+    sim_stats total;
+    if (simulate_parallel(pcs, outcomes, count, parallelChunks,
+                          parallelWarmup, parallelCheck, &total) != 0) {
+      exit(1);
+    }
+
+    // The workers don't report what their filters did
+    memset(&result, 0, sizeof(result));
+    result.branches = total.branches;
+    result.mispredictions = total.mispredictions;
+    print_results(&result);
+    if (cacheable) {
+      result_cache_put(key, &result);
+    }
+    if (costGhz) {
+      // The workers built their own predictors, describe one more
+      print_cost(1);
+    }
+
+    free(pcs);
+    free(outcomes);
+    trace_close(input);
+    trace_index_free(&idx);
+    return 0;
+  }
+
   // Initialize the predictor
-  init_predictor();
+  if (init_predictor() != 0) {
+    fprintf(stderr, "Cannot allocate the predictor tables\n");
+    exit(1);
+  }
 
-  uint32_t num_branches = 0;
-  uint32_t mispredictions = 0;
+  if (prefetchDistance) {
+    aheadPcs = malloc((prefetchDistance + 1) * sizeof(uint32_t));
+    aheadOutcomes = malloc((prefetchDistance + 1) * sizeof(uint8_t));
+  }
+
+  uint64_t num_branches = 0;
+  uint64_t mispredictions = 0;
   uint32_t pc = 0;
   uint8_t outcome = NOTTAKEN;
 
+  // Hardware counters are optional, carry on without them if refused
+  if (perfPeriod && !perf_open()) {
+    perfPeriod = 0;
+  }
+  uint64_t perfSamples = 0;
+  uint64_t perfSnap[4][PERF_NUM_EVENTS];
+
   // Reach each branch from the trace
-  while (read_branch(&pc, &outcome)) {
+  while (1) {
+    int sample = perfPeriod && num_branches % perfPeriod == 0;
+    if (sample) {
+      perf_read(perfSnap[0]);
+    }
+    if (!read_branch(&pc, &outcome)) {
+      break;
+    }
     num_branches++;
+    if (progress && (num_branches & 0xfffff) == 0) {
+      fprintf(stderr, "\r%5.1f%%", 100.0 * num_branches /
+                                    (idx.branches - startBranch));
+    }
+    if (sample) {
+      perf_read(perfSnap[1]);
+    }
 
     // Make a prediction and compare with actual outcome
     uint8_t prediction = make_prediction(pc);
+    if (sample) {
+      perf_read(perfSnap[2]);
+    }
     if (prediction != outcome) {
       mispredictions++;
     }
@@ -131,18 +565,50 @@ main(int argc, char *argv[])
 
     // Train the predictor
     train_predictor(pc, outcome);
+    if (sample) {
+      perf_read(perfSnap[3]);
+      perf_account(PERF_READ, perfSnap[0], perfSnap[1]);
+      perf_account(PERF_PREDICT, perfSnap[1], perfSnap[2]);
+      perf_account(PERF_TRAIN, perfSnap[2], perfSnap[3]);
+      perfSamples++;
+    }
+  }
+
+  if (progress) {
+    fprintf(stderr, "\r%5.1f%%\n", 100.0);
   }
 
   // Print out the mispredict statistics
-  printf("Branches:        %10d\n", num_branches);
-  printf("Incorrect:       %10d\n", mispredictions);
-  float mispredict_rate = 100*((float)mispredictions / (float)num_branches);
-  printf("Misprediction Rate: %7.3f\n", mispredict_rate);
+  result.branches = num_branches;
+  result.mispredictions = mispredictions;
+  filter_stats(&result.filtered, &result.filterMisses);
+  print_results(&result);
+  if (cacheable) {
+    result_cache_put(key, &result);
+  }
+  if (costGhz) {
+    print_cost(0);
+  }
+  if (prefetchDistance) {
+    printf("Prefetch: distance %u, %llu of %llu lines, coverage %.1f%%\n",
+           prefetchDistance, (unsigned long long)prefetched,
+           (unsigned long long)touchedLines,
+           touchedLines ? 100.0 * prefetched / touchedLines : 0.0);
+    free(aheadPcs);
+    free(aheadOutcomes);
+  }
+  if (printLayout) {
+    print_predictor_layout(stdout);
+  }
+  if (perfPeriod) {
+    perf_report(stdout, perfSamples, perfPeriod);
+    perf_close();
+  }
 
   // Cleanup
   clean_predictor();
-  fclose(stream);
-  free(buf);
+  trace_close(input);
+  trace_index_free(&idx);
 
   return 0;
 }
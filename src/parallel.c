@@ -0,0 +1,223 @@
+//========================================================//
+//  parallel.c                                            //
+//  Approximate parallel simulation of a single trace     //
+//                                                        //
+//  predictor.c keeps its state in globals, so each chunk //
+//  runs in a forked worker process: the fork gives it a  //
+//  private predictor instance and a copy-on-write view   //
+//  of the trace, and it sends its counts back on a pipe. //
+//========================================================//
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "predictor.h"
+#include "parallel.h"
+
+static double
+now_seconds()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Train on [warmBegin, begin) without counting, then simulate [begin, end)
+//
+static void
+simulate_range(const uint32_t *pcs, const uint8_t *outcomes,
+               uint64_t warmBegin, uint64_t begin, uint64_t end,
+               sim_stats *stats)
+{
+  for (uint64_t i = warmBegin; i < begin; i++) {
+    train_predictor(pcs[i], outcomes[i]);
+  }
+
+  stats->branches = end - begin;
+  stats->mispredictions = 0;
+  for (uint64_t i = begin; i < end; i++) {
+    if (make_prediction(pcs[i]) != outcomes[i]) {
+      stats->mispredictions++;
+    }
+    train_predictor(pcs[i], outcomes[i]);
+  }
+}
+
+// Fork the worker for chunk 'k': a private predictor, warmed up on the end
+// of the previous chunk, that writes its counts to the returned pipe
+//
+static int
+start_worker(const uint32_t *pcs, const uint8_t *outcomes,
+             const uint64_t *bounds, int k, uint64_t warmup, pid_t *pid,
+             int *pipeFd)
+{
+  int fd[2];
+  if (pipe(fd) != 0) {
+    return -1;
+  }
+  *pid = fork();
+  if (*pid < 0) {
+    close(fd[0]);
+    close(fd[1]);
+    return -1;
+  }
+
+  if (*pid == 0) {
+    close(fd[0]);
+    uint64_t warmBegin = bounds[k] > warmup ? bounds[k] - warmup : 0;
+    sim_stats stats;
+    if (init_predictor() != 0) {
+      // No counts in the pipe tells the parent this chunk failed
+      _exit(1);
+    }
+    simulate_range(pcs, outcomes, warmBegin, bounds[k], bounds[k+1], &stats);
+    int ok = write(fd[1], &stats, sizeof(stats)) == sizeof(stats);
+    _exit(ok ? 0 : 1);
+  }
+
+  close(fd[1]);
+  *pipeFd = fd[0];
+  return 0;
+}
+
+int
+simulate_parallel(const uint32_t *pcs, const uint8_t *outcomes,
+                  uint64_t count, int chunks, uint64_t warmup,
+                  int compare, sim_stats *total)
+{
+  sim_stats *parallel = calloc(chunks, sizeof(sim_stats));
+  sim_stats *serial = calloc(chunks, sizeof(sim_stats));
+  uint64_t *bounds = malloc((chunks + 1) * sizeof(uint64_t));
+  pid_t *pids = malloc(chunks * sizeof(pid_t));
+  int *pipes = malloc(chunks * sizeof(int));
+
+  for (int k = 0; k <= chunks; k++) {
+    bounds[k] = count * k / chunks;
+  }
+
+  // Don't let the workers inherit (and later repeat) buffered output
+  fflush(stdout);
+  double start = now_seconds();
+
+  // At most one worker per core at a time, each with its own tables; the
+  // next chunk starts as soon as a worker finishes
+  int limit = sysconf(_SC_NPROCESSORS_ONLN);
+  if (limit < 1) {
+    limit = 1;
+  }
+
+  int next = 0;
+  int running = 0;
+  int failed = 0;
+  while (next < chunks || running > 0) {
+    while (!failed && next < chunks && running < limit) {
+      int k = next;
+      if (start_worker(pcs, outcomes, bounds, k, warmup, &pids[k],
+                       &pipes[k]) != 0) {
+        failed = 1;
+        break;
+      }
+      next++;
+      running++;
+    }
+    if (running == 0) {
+      break;
+    }
+
+    pid_t pid = waitpid(-1, NULL, 0);
+    if (pid < 0) {
+      failed = 1;
+      break;
+    }
+    for (int k = 0; k < next; k++) {
+      if (pids[k] != pid) {
+        continue;
+      }
+      // The counts are already sitting in the pipe
+      if (read(pipes[k], &parallel[k], sizeof(sim_stats)) !=
+          sizeof(sim_stats)) {
+        failed = 1;
+      }
+      close(pipes[k]);
+      pids[k] = 0;
+      running--;
+    }
+  }
+  double parallelTime = now_seconds() - start;
+
+  if (failed) {
+    fprintf(stderr, "parallel: could not run %d workers\n", chunks);
+    free(parallel);
+    free(serial);
+    free(bounds);
+    free(pids);
+    free(pipes);
+    return -1;
+  }
+
+  // Reference: one predictor over the whole trace, counted per chunk
+  double serialTime = 0;
+  if (compare) {
+    start = now_seconds();
+    if (init_predictor() != 0) {
+      fprintf(stderr, "parallel: cannot allocate the serial reference\n");
+      free(parallel);
+      free(serial);
+      free(bounds);
+      free(pids);
+      free(pipes);
+      return -1;
+    }
+    for (int k = 0; k < chunks; k++) {
+      simulate_range(pcs, outcomes, bounds[k], bounds[k], bounds[k+1],
+                     &serial[k]);
+    }
+    clean_predictor();
+    serialTime = now_seconds() - start;
+  }
+
+  total->branches = 0;
+  total->mispredictions = 0;
+  uint64_t serialMispredictions = 0;
+  for (int k = 0; k < chunks; k++) {
+    total->branches += parallel[k].branches;
+    total->mispredictions += parallel[k].mispredictions;
+    serialMispredictions += serial[k].mispredictions;
+  }
+
+  printf("Parallel: %d chunks, %llu branch warmup, %.3fs\n", chunks,
+         (unsigned long long)warmup, parallelTime);
+  printf("  %5s %12s %12s", "chunk", "branches", "incorrect");
+  if (compare) {
+    printf(" %12s %8s", "serial", "delta");
+  }
+  printf("\n");
+  for (int k = 0; k < chunks; k++) {
+    printf("  %5d %12llu %12llu", k,
+           (unsigned long long)parallel[k].branches,
+           (unsigned long long)parallel[k].mispredictions);
+    if (compare) {
+      printf(" %12llu %+8lld", (unsigned long long)serial[k].mispredictions,
+             (long long)(parallel[k].mispredictions - serial[k].mispredictions));
+    }
+    printf("\n");
+  }
+
+  if (compare) {
+    double rate = 100 * ((double)total->mispredictions / total->branches);
+    double serialRate = 100 * ((double)serialMispredictions / total->branches);
+    printf("Serial Incorrect:  %10llu (%.3fs, speedup %.2fx)\n",
+           (unsigned long long)serialMispredictions, serialTime,
+           parallelTime > 0 ? serialTime / parallelTime : 0);
+    printf("Rate Deviation:    %+10.4f\n", rate - serialRate);
+  }
+
+  free(parallel);
+  free(serial);
+  free(bounds);
+  free(pids);
+  free(pipes);
+  return 0;
+}
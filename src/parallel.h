@@ -0,0 +1,34 @@
+//========================================================//
+//  parallel.h                                            //
+//  Approximate parallel simulation of a single trace     //
+//                                                        //
+//  The trace is cut into chunks that are simulated at    //
+//  the same time, each by a private predictor that is    //
+//  first warmed up on the tail of the previous chunk.    //
+//========================================================//
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stdint.h>
+
+typedef struct {
+  uint64_t branches;
+  uint64_t mispredictions;
+} sim_stats;
+
+// Simulate a trace held in memory as 'chunks' pieces, each warmed up on
+// the 'warmup' branches before it, and print a per-chunk report. When
+// 'compare' is set the exact serial run is performed as well and the
+// deviation of the merged result from it is reported.
+//
+// At most one worker per online core runs at a time, so only that many
+// predictors exist at once. The predictor configuration globals must be
+// set; init_predictor() is called by every worker. Returns the merged statistics in 'total', and
+// 0 on success or -1 if the workers could not be started.
+//
+int simulate_parallel(const uint32_t *pcs, const uint8_t *outcomes,
+                      uint64_t count, int chunks, uint64_t warmup,
+                      int compare, sim_stats *total);
+
+#endif
@@ -0,0 +1,197 @@
+//========================================================//
+//  perfcount.c                                           //
+//  Hardware performance counters for the simulation loop //
+//                                                        //
+//  All events are opened as one perf group so a single   //
+//  read() snapshots every counter at once. Events the    //
+//  CPU or kernel refuse are left out and reported n/a.   //
+//========================================================//
+#define _GNU_SOURCE
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "perfcount.h"
+
+static const char *eventName[PERF_NUM_EVENTS] = {
+  "cycles", "instructions", "LLC-misses", "dTLB-misses"
+};
+static const char *phaseName[PERF_NUM_PHASES] = { "read", "predict", "train" };
+
+static int fds[PERF_NUM_EVENTS];
+static int slot[PERF_NUM_EVENTS];  // Position in the group read, -1 if not opened
+static int numOpen = 0;
+static int leader = -1;
+
+// Cost of back to back perf_read() calls, subtracted from every delta
+static uint64_t overhead[PERF_NUM_EVENTS];
+static uint64_t totals[PERF_NUM_PHASES][PERF_NUM_EVENTS];
+
+static long
+perf_event_open(struct perf_event_attr *attr, int groupFd)
+{
+  // Count this thread on any CPU
+  return syscall(__NR_perf_event_open, attr, 0, -1, groupFd, 0);
+}
+
+static void
+event_attr(int event, struct perf_event_attr *attr)
+{
+  memset(attr, 0, sizeof(*attr));
+  attr->size = sizeof(*attr);
+  attr->disabled = 1;
+  attr->exclude_kernel = 1;
+  attr->exclude_hv = 1;
+  attr->read_format = PERF_FORMAT_GROUP;
+
+  switch (event) {
+    case PERF_CYCLES:
+      attr->type = PERF_TYPE_HARDWARE;
+      attr->config = PERF_COUNT_HW_CPU_CYCLES;
+      break;
+    case PERF_INSTRUCTIONS:
+      attr->type = PERF_TYPE_HARDWARE;
+      attr->config = PERF_COUNT_HW_INSTRUCTIONS;
+      break;
+    case PERF_LLC_MISSES:
+      attr->type = PERF_TYPE_HARDWARE;
+      attr->config = PERF_COUNT_HW_CACHE_MISSES;
+      break;
+    case PERF_DTLB_MISSES:
+      attr->type = PERF_TYPE_HW_CACHE;
+      attr->config = PERF_COUNT_HW_CACHE_DTLB |
+                     (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+      break;
+  }
+}
+
+int
+perf_open()
+{
+  int firstErrno = 0;
+
+  for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+    struct perf_event_attr attr;
+    event_attr(e, &attr);
+
+    fds[e] = perf_event_open(&attr, leader);
+    if (fds[e] < 0) {
+      if (!firstErrno) {
+        firstErrno = errno;
+      }
+      slot[e] = -1;
+      continue;
+    }
+    if (leader < 0) {
+      leader = fds[e];
+    }
+    slot[e] = numOpen++;
+  }
+
+  if (numOpen == 0) {
+    fprintf(stderr, "perf: hardware counters unavailable (%s), "
+                    "continuing without them\n", strerror(firstErrno));
+    return 0;
+  }
+  for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+    if (slot[e] < 0) {
+      fprintf(stderr, "perf: %s not supported here, reporting n/a\n",
+              eventName[e]);
+    }
+  }
+
+  ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+
+  // Calibrate the cost of the measurement itself
+  uint64_t a[PERF_NUM_EVENTS], b[PERF_NUM_EVENTS];
+  for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+    overhead[e] = UINT64_MAX;
+  }
+  for (int i = 0; i < 1000; i++) {
+    perf_read(a);
+    perf_read(b);
+    for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+      if (b[e] - a[e] < overhead[e]) {
+        overhead[e] = b[e] - a[e];
+      }
+    }
+  }
+
+  return numOpen;
+}
+
+void
+perf_read(uint64_t values[PERF_NUM_EVENTS])
+{
+  // PERF_FORMAT_GROUP layout: nr, then one value per member
+  uint64_t buf[1 + PERF_NUM_EVENTS];
+
+  if (numOpen == 0 || read(leader, buf, sizeof(buf)) <= 0) {
+    memset(values, 0, PERF_NUM_EVENTS * sizeof(uint64_t));
+    return;
+  }
+  for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+    values[e] = slot[e] < 0 ? 0 : buf[1 + slot[e]];
+  }
+}
+
+void
+perf_account(int phase, const uint64_t before[PERF_NUM_EVENTS],
+             const uint64_t after[PERF_NUM_EVENTS])
+{
+  for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+    uint64_t delta = after[e] - before[e];
+    // Clamp at zero, short phases can come in under the calibrated cost
+    totals[phase][e] += delta > overhead[e] ? delta - overhead[e] : 0;
+  }
+}
+
+void
+perf_report(FILE *out, uint64_t samples, unsigned period)
+{
+  if (numOpen == 0 || samples == 0) {
+    return;
+  }
+
+  fprintf(out, "Perf counters per branch (1 in %u branches sampled, "
+               "%llu samples):\n", period, (unsigned long long)samples);
+  fprintf(out, "  %-8s", "phase");
+  for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+    fprintf(out, " %13s", eventName[e]);
+  }
+  fprintf(out, " %7s\n", "IPC");
+
+  for (int p = 0; p < PERF_NUM_PHASES; p++) {
+    fprintf(out, "  %-8s", phaseName[p]);
+    for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+      if (slot[e] < 0) {
+        fprintf(out, " %13s", "n/a");
+      } else {
+        fprintf(out, " %13.3f", (double)totals[p][e] / samples);
+      }
+    }
+    if (slot[PERF_CYCLES] >= 0 && slot[PERF_INSTRUCTIONS] >= 0 &&
+        totals[p][PERF_CYCLES]) {
+      fprintf(out, " %7.2f\n", (double)totals[p][PERF_INSTRUCTIONS] /
+                               totals[p][PERF_CYCLES]);
+    } else {
+      fprintf(out, " %7s\n", "n/a");
+    }
+  }
+}
+
+void
+perf_close()
+{
+  for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+    if (slot[e] >= 0) {
+      close(fds[e]);
+    }
+  }
+  numOpen = 0;
+  leader = -1;
+}
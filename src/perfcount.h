@@ -0,0 +1,52 @@
+//========================================================//
+//  perfcount.h                                           //
+//  Hardware performance counters for the simulation loop //
+//                                                        //
+//  Thin wrapper over perf_event_open(2) that counts the  //
+//  user-space cost of each phase of main()'s loop.       //
+//========================================================//
+
+#ifndef PERFCOUNT_H
+#define PERFCOUNT_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Counted events, in report order
+#define PERF_CYCLES        0
+#define PERF_INSTRUCTIONS  1
+#define PERF_LLC_MISSES    2
+#define PERF_DTLB_MISSES   3
+#define PERF_NUM_EVENTS    4
+
+// Phases of the simulation loop
+#define PERF_READ     0
+#define PERF_PREDICT  1
+#define PERF_TRAIN    2
+#define PERF_NUM_PHASES 3
+
+// Open the counters. Returns the number of events that could be opened;
+// 0 means counters are unavailable (no kernel support, not permitted by
+// perf_event_paranoid, running in a VM without a PMU...) and every other
+// call below becomes a no-op. The reason is printed to stderr.
+//
+int perf_open();
+
+// Read the current value of every counter into 'values'
+//
+void perf_read(uint64_t values[PERF_NUM_EVENTS]);
+
+// Charge the counts between two perf_read() snapshots to 'phase'
+//
+void perf_account(int phase, const uint64_t before[PERF_NUM_EVENTS],
+                  const uint64_t after[PERF_NUM_EVENTS]);
+
+// Print the per-branch averages over 'samples' sampled branches
+//
+void perf_report(FILE *out, uint64_t samples, unsigned period);
+
+// Close the counters
+//
+void perf_close();
+
+#endif
@@ -6,6 +6,8 @@
 //  described in the README                               //
 //========================================================//
 #include <stdio.h>
+#include <limits.h>
+#include <string.h>
 #include <math.h>  
 #include "predictor.h"
 
@@ -30,6 +32,11 @@ int pcIndexBits;  // Number of bits used for PC index
 int bpType;       // Branch Prediction Type
 int verbose;
 int customType;
+int tablePages = ARENA_TRANSPARENT; // Page backing for the tables (arena.h)
+int tableNuma;    // Bind the tables to the NUMA node of the simulating thread
+int filterBits;   // Index bits of the bias filter in front of bpType (0 = off)
+int filterConfidence = FILTER_CONFIDENCE; // Same-direction run that settles a branch
+int updateDelay;  // Branches table updates are held back for (0 = immediate)
 
 //------------------------------------//
 //      Predictor Data Structures     //
@@ -38,6 +45,9 @@ int customType;
 //
 //TODO: Add your own Branch Predictor data structures here
 //
+// Every table below is carved out of this one mapping
+arena tables;
+
 // GShare
 unsigned ghistory;
 unsigned mask;
@@ -70,15 +80,115 @@ int psize;
 int threshold;
 int** perceptrons;
 
+// Custom (Path-based neural, Jimenez style)
+// Uses ghistoryBits as the path length and pcIndexBits for the weight table
+// unsigned pmask; (Already declared for perceptron)
+// int psize; (Already declared for perceptron)
+// int threshold; (Already declared for perceptron)
+int pathLength;
+int* pathWeights;     // psize rows of (pathLength + 1) weights, bias first
+int* pathSums;        // Running partial sums, pathSums[pathLength] is complete
+int* pathRows;        // pathRows[j] = weight row of the branch j back (1-based)
+uint8_t* pathOutcomes; // pathOutcomes[j] = outcome of the branch j back
+
+// Bias filter, one entry per PC slot tagged with the full PC
+typedef struct {
+  uint32_t pc;
+  uint8_t dir;          // Direction of the current run
+  uint8_t count;        // Length of the run, saturating at 2 * filterConfidence
+} filter_entry;
+
+unsigned filterMask;
+filter_entry* filter;
+uint64_t filteredBranches;  // Branches answered by the filter
+uint64_t filterMisses;      // ... of which it got wrong
+
+// Table updates held back by updateDelay
+typedef struct {
+  int* cell;
+  int delta;
+  int lo;
+  int hi;
+} pending_update;
+
+pending_update* pending;
+unsigned numPending;
+unsigned pendingCap;
+int delayedBranches;    // Branches trained since the last batch
 
 
 //------------------------------------//
 //        Predictor Functions         //
 //------------------------------------//
 
+// Map every table of the configured predictor in one go.
+// Returns 0 on success and -1 if the mapping cannot be made.
+static int
+alloc_tables(const arena_request *requests, int count)
+{
+  // The bias filter shares the mapping with whatever it sits in front of
+  arena_request all[ARENA_MAX_TABLES];
+  for (int i = 0; i < count; i++) {
+    all[i] = requests[i];
+  }
+  if (filterBits > 0) {
+    filterMask = (1 << filterBits) - 1;
+    all[count].name = "filter";
+    all[count].ptr = (void**)&filter;
+    all[count].size = ((size_t)1 << filterBits) * sizeof(filter_entry);
+    count++;
+  }
+  filteredBranches = 0;
+  filterMisses = 0;
+
+  return arena_create(&tables, all, count, tablePages, tableNuma) != 0 ? -1 : 0;
+}
+
+// Add 'delta' to a table cell unless that moves it below 'lo' or above
+// 'hi', right away or, with --delay, when the current batch is applied.
+// Histories are always updated immediately, only counters and weights are
+// held back.
+static void
+update_cell(int* cell, int delta, int lo, int hi)
+{
+  if (!updateDelay) {
+    int v = *cell + delta;
+    if (delta < 0 ? v >= lo : v <= hi) {
+      *cell = v;
+    }
+    return;
+  }
+
+  if (numPending == pendingCap) {
+    pendingCap = pendingCap ? pendingCap * 2 : 1024;
+    pending = realloc(pending, pendingCap * sizeof(pending_update));
+  }
+  pending_update* u = &pending[numPending];
+  u->cell = cell;
+  u->delta = delta;
+  u->lo = lo;
+  u->hi = hi;
+  numPending++;
+}
+
+// Apply every held back update, oldest first
+static void
+flush_updates()
+{
+  for (unsigned i = 0; i < numPending; i++) {
+    pending_update* u = &pending[i];
+    int v = *u->cell + u->delta;
+    if (u->delta < 0 ? v >= u->lo : v <= u->hi) {
+      *u->cell = v;
+    }
+  }
+  numPending = 0;
+  delayedBranches = 0;
+}
+
 // Init functions for my custom predictors
 
-void init_custom_tournament(){
+int init_custom_tournament(){
   // Copied from tournament set up with set-in-stone bit numbers
   ghistoryBits = 25;
   lhistoryBits = 25;
@@ -94,29 +204,36 @@ void init_custom_tournament(){
   lhsize = 1 << pcIndexBits;
   lpsize = 1 << lhistoryBits;
 
-  global = calloc(gsize, sizeof(int));
+  arena_request requests[] = {
+    { "global", (void**)&global, gsize * sizeof(int) },
+    { "lhistories", (void**)&lhistories, lhsize * sizeof(unsigned) },
+    { "lpredict", (void**)&lpredict, lpsize * sizeof(int) },
+    { "choices", (void**)&choices, gsize * sizeof(int) },
+  };
+  if (alloc_tables(requests, 4) != 0) {
+    return -1;
+  }
+
   for (int i = 0; i < gsize; i++) {
     global[i] = WN;
   }
 
-  lhistories = calloc(lhsize, sizeof(unsigned));
   for (int i = 0; i < lhsize; i++) {
     lhistories[i] = 0;
   }
 
-  lpredict = calloc(lpsize, sizeof(int));
   for (int i = 0; i < lpsize; i++) {
     lpredict[i] = WN;
   }
 
   // Weak local default
-  choices = calloc(gsize, sizeof(int));
   for (int i = 0; i < gsize; i++) {
     choices[i] = 2;
   }
+  return 0;
 }
 
-void init_custom_perceptron(){
+int init_custom_perceptron(){
   // Setting these in stone
   ghistoryBits = 28;
   pcIndexBits = 9;
@@ -131,18 +248,52 @@ void init_custom_perceptron(){
   
   psize = 1 << pcIndexBits;
 
-  // Table of perceptron arrays that are bias + weights indexed by pc
-  perceptrons = calloc(psize, sizeof(int*));
+  // Table of perceptron arrays that are bias + weights indexed by pc,
+  // the rows themselves live back to back in one weight block
+  int* weights;
+  arena_request requests[] = {
+    { "perceptrons", (void**)&perceptrons, psize * sizeof(int*) },
+    { "weights", (void**)&weights, psize * (ghistoryBits + 1) * sizeof(int) },
+  };
+  if (alloc_tables(requests, 2) != 0) {
+    return -1;
+  }
   for (int i = 0; i < psize; i++) {
-    perceptrons[i] = calloc(ghistoryBits + 1, sizeof(int));
+    perceptrons[i] = weights + i * (ghistoryBits + 1);
   }
 
-  return;
+  return 0;
+}
+
+int init_custom_path(){
+  // Configurable, fall back to a 32 branch path and 512 rows
+  if (ghistoryBits <= 0){
+    ghistoryBits = 32;
+  }
+  if (pcIndexBits <= 0){
+    pcIndexBits = 9;
+  }
+  pathLength = ghistoryBits;
+
+  threshold = (1.93 * pathLength + 14);
+
+  pmask = (1 << pcIndexBits) - 1;
+  psize = 1 << pcIndexBits;
+
+  // Weights start at zero like the perceptron's
+  arena_request requests[] = {
+    { "pathWeights", (void**)&pathWeights,
+      (size_t)psize * (pathLength + 1) * sizeof(int) },
+    { "pathSums", (void**)&pathSums, (pathLength + 1) * sizeof(int) },
+    { "pathRows", (void**)&pathRows, (pathLength + 1) * sizeof(int) },
+    { "pathOutcomes", (void**)&pathOutcomes, (pathLength + 1) * sizeof(uint8_t) },
+  };
+  return alloc_tables(requests, 4);
 }
 
 // Initialize the predictor
 //
-void
+int
 init_predictor()
 {
   switch (bpType) {
@@ -159,12 +310,17 @@ init_predictor()
       bhtBits = 1 << ghistoryBits;
 
       // Allocate the branch history table and init everything to weak not taken
-      bht = calloc(bhtBits, sizeof(int));
+      arena_request requests[] = {
+        { "bht", (void**)&bht, bhtBits * sizeof(int) },
+      };
+      if (alloc_tables(requests, 1) != 0) {
+        return -1;
+      }
       for (int i = 0; i < bhtBits; i++) {
         bht[i] = WN;
       }
 
-      return;
+      return 0;
     }
     case TOURNAMENT: {
       ghistory = 0;
@@ -177,41 +333,113 @@ init_predictor()
       lhsize = 1 << pcIndexBits;
       lpsize = 1 << lhistoryBits;
 
-      global = calloc(gsize, sizeof(int));
+      arena_request requests[] = {
+        { "global", (void**)&global, gsize * sizeof(int) },
+        { "lhistories", (void**)&lhistories, lhsize * sizeof(unsigned) },
+        { "lpredict", (void**)&lpredict, lpsize * sizeof(int) },
+        { "choices", (void**)&choices, gsize * sizeof(int) },
+      };
+      if (alloc_tables(requests, 4) != 0) {
+        return -1;
+      }
+
       for (int i = 0; i < gsize; i++) {
         global[i] = WN;
       }
 
-      lhistories = calloc(lhsize, sizeof(unsigned));
       for (int i = 0; i < lhsize; i++) {
         lhistories[i] = 0;
       }
 
-      lpredict = calloc(lpsize, sizeof(int));
       for (int i = 0; i < lpsize; i++) {
         lpredict[i] = WN;
       }
 
       // Which do you default to? Weak for sure, but local or global? 1-2
-      choices = calloc(gsize, sizeof(int));
       for (int i = 0; i < gsize; i++) {
         choices[i] = 2;
       }
-      return;
+      return 0;
     }
     case CUSTOM: {
       // Initialize differently depending on the different custom function
       if (customType == 0){
-        init_custom_tournament();
+        return init_custom_tournament();
       }
       else if (customType == 1){
-        init_custom_perceptron();
+        return init_custom_perceptron();
+      }
+      else if (customType == 2){
+        return init_custom_path();
       }
-      return;
+      return 0;
     }
     default:
-      return;
+      // Static has no tables of its own, but may still have a filter
+      if (filterBits > 0) {
+        return alloc_tables(NULL, 0);
+      }
+      return 0;
+  }
+}
+
+// Bias filter
+// A branch whose last filterConfidence outcomes went the same way is
+// answered by the filter and never reaches the backing predictor, which
+// neither looks it up nor trains on it (nor shifts it into its history)
+// until the run breaks.
+
+// Non-zero if the filter is confident about 'pc', with the direction
+static int
+filter_lookup(uint32_t pc, uint8_t *dir){
+  filter_entry* f = &filter[pc & filterMask];
+  if (f->pc == pc && f->count >= filterConfidence){
+    *dir = f->dir;
+    return 1;
   }
+  return 0;
+}
+
+// Record the outcome; returns 1 if the filter answered this branch correctly
+// and the backing predictor can be left alone
+static int
+filter_train(uint32_t pc, uint8_t outcome){
+  filter_entry* f = &filter[pc & filterMask];
+  int limit = 2 * filterConfidence;
+  if (limit > 255){
+    limit = 255;
+  }
+
+  if (f->pc != pc){
+    // Settled branches wear down before another PC may take the slot
+    if (f->count > 0){
+      f->count--;
+    }
+    if (f->count == 0){
+      f->pc = pc;
+      f->dir = outcome;
+      f->count = 1;
+    }
+    return 0;
+  }
+
+  int settled = f->count >= filterConfidence;
+  if (settled){
+    filteredBranches++;
+  }
+  if (f->dir != outcome){
+    // Run broken, the backing predictor has to learn this branch again
+    if (settled){
+      filterMisses++;
+    }
+    f->dir = outcome;
+    f->count = 1;
+    return 0;
+  }
+  if (f->count < limit){
+    f->count++;
+  }
+  return settled;
 }
 
 // Prediction Functions for the two Custom Predictors
@@ -295,6 +523,21 @@ int custom_perceptron(uint32_t pc){
 
 }
 
+// Path-based neural predictor
+// The history part of the dot product was already accumulated one step per
+// branch in pathSums, so only this branch's bias is left to add
+int custom_path(uint32_t pc){
+  int* weights = &pathWeights[(size_t)(pc & pmask) * (pathLength + 1)];
+
+  int sum = pathSums[pathLength] + weights[0];
+  if (sum < 0){
+    return NOTTAKEN;
+  }
+  else{
+    return TAKEN;
+  }
+}
+
 // Make a prediction for conditional branch instruction at PC 'pc'
 // Returning TAKEN indicates a prediction of taken; returning NOTTAKEN
 // indicates a prediction of not taken
@@ -302,6 +545,11 @@ int custom_perceptron(uint32_t pc){
 uint8_t
 make_prediction(uint32_t pc)
 {
+  uint8_t dir;
+  if (filter && filter_lookup(pc, &dir)) {
+    return dir;
+  }
+
   // Make a prediction based on the bpType
   switch (bpType) {
     case STATIC:
@@ -361,6 +609,9 @@ make_prediction(uint32_t pc)
       else if (customType == 1){
         prediction = custom_perceptron(pc);
       }
+      else if (customType == 2){
+        prediction = custom_path(pc);
+      }
       return prediction;
     }
     default:
@@ -377,7 +628,6 @@ make_prediction(uint32_t pc)
 void train_custom_tournament(uint32_t pc, uint8_t outcome){
   // Important: Using the PC as the choice index instead of the globalhistory
   int choiceIndex = pc & mask;
-  int choice = choices[choiceIndex];
 
   // Select Global Predictor
   int ghistoryIndex = ghistory & mask;
@@ -409,38 +659,19 @@ void train_custom_tournament(uint32_t pc, uint8_t outcome){
   }
 
   // Update the global and local histories with this new outcome
-  if(outcome != TAKEN){
-    if (gprediction != SN){
-      global[ghistoryIndex] = gprediction - 1;
-    }
-    if (lprediction != SN){
-      lpredict[lpIndex] = lprediction - 1;
-    }
-  }
-  else{
-    if (gprediction != ST){
-      global[ghistoryIndex] = gprediction + 1;
-    }
-    if (lprediction != ST){
-      lpredict[lpIndex] = lprediction + 1;
-    }
-  }
+  int step = outcome == TAKEN ? 1 : -1;
+  update_cell(&global[ghistoryIndex], step, SN, ST);
+  update_cell(&lpredict[lpIndex], step, SN, ST);
 
   // If the two had different predictions, update which one you choose based on who was right
   if (gout != lout){
     // Favor global chances
     if(gout == outcome){
-      if (choice < 3){
-        choice++;
-        choices[choiceIndex] = choice;
-      }
+      update_cell(&choices[choiceIndex], 1, 0, 3);
     } 
     // Favor local chances
     else {
-      if (choice > 0){
-        choice--;
-        choices[choiceIndex] = choice;
-      }
+      update_cell(&choices[choiceIndex], -1, 0, 3);
     }
   }
 
@@ -502,19 +733,8 @@ void train_custom_perceptron(uint32_t pc, uint8_t outcome){
   }
 
   if (abs(sum) <=  threshold){
-    // Update the bias with your actual outcome
-    if (outcomeVal == -1){
-      // Stay within your bounds
-      if (bias > -128){
-        perceptron[0]--;
-      }
-    }
-    else{
-      // Stay within your bounds
-      if (bias < 127){
-        perceptron[0]++;
-      }
-    }
+    // Update the bias with your actual outcome, staying within your bounds
+    update_cell(&perceptron[0], outcomeVal, -128, 127);
 
     // Update the weight for every bit on if it matches the outcome
     for (int i = 0; i < ghistoryBits; i++) {
@@ -530,21 +750,9 @@ void train_custom_perceptron(uint32_t pc, uint8_t outcome){
 
       // Should come out to 1 if they match and -1 if they don't
       int newWeight = outcomeVal * bitVal;
-      // Don't forget the bias
-      int currWeight = perceptron[i + 1];
 
       // Update the weight within the bounds
-      if (newWeight < 0){
-        if (currWeight > -128){
-          perceptron[i + 1] = currWeight + newWeight;
-        }
-      }
-      else{
-        if (currWeight < 127){
-          perceptron[i + 1] = currWeight + newWeight;
-        }
-
-      }
+      update_cell(&perceptron[i + 1], newWeight, -128, 127);
     }
   }
   else if (prediction != outcome) {
@@ -553,14 +761,14 @@ void train_custom_perceptron(uint32_t pc, uint8_t outcome){
       // Stay within your bounds
       if (bias > -128){
         // Increase the bias
-        perceptron[0]++;
+        update_cell(&perceptron[0], 1, INT_MIN, INT_MAX);
       }
     }
     else{
       // Stay within your bounds
       if (bias < 127){
         // Decrease the bias
-        perceptron[0]--;
+        update_cell(&perceptron[0], -1, INT_MIN, INT_MAX);
       }
     }
 
@@ -578,21 +786,9 @@ void train_custom_perceptron(uint32_t pc, uint8_t outcome){
 
       // Should come out to 1 if they match and -1 if they don't
       int newWeight = outcomeVal * bitVal;
-      // Don't forget the bias
-      int currWeight = perceptron[i + 1];
 
       // Update the weight within the bounds
-      if (newWeight < 0){
-        if (currWeight > -128){
-          perceptron[i + 1] = currWeight + newWeight;
-        }
-      }
-      else{
-        if (currWeight < 127){
-          perceptron[i + 1] = currWeight + newWeight;
-        }
-
-      }
+      update_cell(&perceptron[i + 1], newWeight, -128, 127);
     }
   }
 
@@ -603,6 +799,52 @@ void train_custom_perceptron(uint32_t pc, uint8_t outcome){
   return;
 }
 
+// Keep a weight within the same 8-bit range the perceptron uses
+static void
+bump_weight(int* weight, int up){
+  update_cell(weight, up ? 1 : -1, -128, 127);
+}
+
+// Custom path-based neural training
+void train_custom_path(uint32_t pc, uint8_t outcome){
+  int row = pc & pmask;
+  int* weights = &pathWeights[(size_t)row * (pathLength + 1)];
+
+  int sum = pathSums[pathLength] + weights[0];
+  int prediction = TAKEN;
+  if (sum < 0){
+    prediction = NOTTAKEN;
+  }
+
+  // Train the bias here and weight j in the row of the branch j back, the
+  // same weights that were summed into this prediction
+  if (prediction != outcome || abs(sum) <= threshold){
+    bump_weight(&weights[0], outcome == TAKEN);
+    for (int j = 1; j <= pathLength; j++) {
+      int* w = &pathWeights[(size_t)pathRows[j] * (pathLength + 1) + j];
+      bump_weight(w, pathOutcomes[j] == outcome);
+    }
+  }
+
+  // Push this branch into every pending sum: the sum that completes k
+  // branches from now needs this row's weight k
+  for (int k = pathLength - 1; k >= 0; k--) {
+    int w = weights[pathLength - k];
+    pathSums[k + 1] = pathSums[k] + (outcome == TAKEN ? w : -w);
+  }
+  pathSums[0] = 0;
+
+  // Shift the path
+  for (int j = pathLength; j > 1; j--) {
+    pathRows[j] = pathRows[j - 1];
+    pathOutcomes[j] = pathOutcomes[j - 1];
+  }
+  pathRows[1] = row;
+  pathOutcomes[1] = outcome;
+
+  return;
+}
+
 // Train the predictor the last executed branch at PC 'pc' and with
 // outcome 'outcome' (true indicates that the branch was taken, false
 // indicates that the branch was not taken)
@@ -610,28 +852,23 @@ void train_custom_perceptron(uint32_t pc, uint8_t outcome){
 void
 train_predictor(uint32_t pc, uint8_t outcome)
 {
+  // The updates of the last updateDelay branches land before this one's
+  if (updateDelay && ++delayedBranches > updateDelay) {
+    flush_updates();
+    delayedBranches = 1;
+  }
+
+  if (filter && filter_train(pc, outcome)) {
+    return;
+  }
+
   switch (bpType) {
     case GSHARE: {
       // Same as before, grab the xor value and make sure it fits inside the mask/bht table
       int xorval = pc ^ ghistory;
       int predindex = xorval & mask;
-      // Grab the original prediction
-      int prediction = bht[predindex];
-      
       // Update the prediction for this value of the table, making sure not to go out of bounds as to accepted values
-      if (outcome == TAKEN){
-        if (prediction != ST){
-          prediction++;
-        }
-      }
-      else{
-        if (prediction != SN){
-          prediction--;
-        }
-      }
-
-      // Store the new prediction for this index
-      bht[predindex] = prediction;
+      update_cell(&bht[predindex], outcome == TAKEN ? 1 : -1, SN, ST);
 
       // Update the global history
       // Shift it left 1 (opening up a new 0 on the right), fill that spot with the actual outcome
@@ -643,7 +880,6 @@ train_predictor(uint32_t pc, uint8_t outcome)
     }
     case TOURNAMENT: {
       int ghistoryIndex = ghistory & mask;
-      int choice = choices[ghistoryIndex];
 
       // Select Global Predictor
       int gprediction = global[ghistoryIndex];
@@ -674,38 +910,19 @@ train_predictor(uint32_t pc, uint8_t outcome)
       }
 
       // Update the global and local histories with this new outcome
-      if(outcome != TAKEN){
-        if (gprediction != SN){
-          global[ghistoryIndex] = gprediction - 1;
-        }
-        if (lprediction != SN){
-          lpredict[lpIndex] = lprediction - 1;
-        }
-      }
-      else{
-        if (gprediction != ST){
-          global[ghistoryIndex] = gprediction + 1;
-        }
-        if (lprediction != ST){
-          lpredict[lpIndex] = lprediction + 1;
-        }
-      }
+      int step = outcome == TAKEN ? 1 : -1;
+      update_cell(&global[ghistoryIndex], step, SN, ST);
+      update_cell(&lpredict[lpIndex], step, SN, ST);
 
       // If the two had different predictions, update which one you choose based on who was right
       if (gout != lout){
         // Favor global chances
         if(gout == outcome){
-          if (choice < 3){
-            choice++;
-            choices[ghistoryIndex] = choice;
-          }
+          update_cell(&choices[ghistoryIndex], 1, 0, 3);
         } 
         // Favor local chances
         else {
-          if (choice > 0){
-            choice--;
-            choices[ghistoryIndex] = choice;
-          }
+          update_cell(&choices[ghistoryIndex], -1, 0, 3);
         }
       }
 
@@ -730,6 +947,9 @@ train_predictor(uint32_t pc, uint8_t outcome)
       else if (customType == 1){
         train_custom_perceptron(pc, outcome);
       }
+      else if (customType == 2){
+        train_custom_path(pc, outcome);
+      }
       break;
     }
     default:
@@ -740,36 +960,440 @@ train_predictor(uint32_t pc, uint8_t outcome)
 
 }
 
-void clean_predictor(){
-  // Free all the data structures you created 
+// Prefetch every cache line of the 'bytes' long table slice at 'p'.
+// Returns the number of lines prefetched.
+static int
+prefetch_range(const void *p, size_t bytes)
+{
+  uintptr_t first = (uintptr_t)p & ~(uintptr_t)(ARENA_ALIGN - 1);
+  uintptr_t last = ((uintptr_t)p + bytes - 1) & ~(uintptr_t)(ARENA_ALIGN - 1);
+  for (uintptr_t line = first; line <= last; line += ARENA_ALIGN) {
+    __builtin_prefetch((const void*)line, 1);
+  }
+  return (last - first) / ARENA_ALIGN + 1;
+}
 
-  // GShare
-  if (bht){
-    free(bht);
+// Prefetch the table lines the lookup and training of the branch at 'pc'
+// will touch, given the global history it will see (the caller knows it
+// ahead of time while replaying a trace). Only entries whose index depends
+// on nothing but the PC and the outcome history can be reached; the local
+// pattern table needs the local history stored in lhistories first, and the
+// path predictor's older rows are only known once the path has been walked.
+//
+// Returns the number of cache lines prefetched
+//
+int
+prefetch_predictor(uint32_t pc, unsigned history)
+{
+  switch (bpType) {
+    case GSHARE: {
+      return prefetch_range(&bht[(pc ^ history) & mask], sizeof(int));
+    }
+    case TOURNAMENT: {
+      int ghistoryIndex = history & mask;
+      return prefetch_range(&choices[ghistoryIndex], sizeof(int)) +
+             prefetch_range(&global[ghistoryIndex], sizeof(int)) +
+             prefetch_range(&lhistories[pc & lhmask], sizeof(unsigned));
+    }
+    case CUSTOM: {
+      if (customType == 0){
+        return prefetch_range(&choices[pc & mask], sizeof(int)) +
+               prefetch_range(&global[history & mask], sizeof(int)) +
+               prefetch_range(&lhistories[pc & lhmask], sizeof(unsigned));
+      }
+      else if (customType == 1){
+        // The rows are packed, so bias + 28 weights straddle two or three
+        // cache lines depending on where the row starts
+        int* perceptron = perceptrons[pc & pmask];
+        return prefetch_range(perceptron, (ghistoryBits + 1) * sizeof(int));
+      }
+      else if (customType == 2){
+        // Prediction only reads the bias; training reads the rest of the row
+        return prefetch_range(&pathWeights[(size_t)(pc & pmask) * (pathLength + 1)],
+                              (pathLength + 1) * sizeof(int));
+      }
+      return 0;
+    }
+    default:
+      return 0;
   }
+}
 
-  // Tournament and Custom Tournament
-  if (global){
-    free(global);
+// Distinct cache lines touched by one branch: an open addressing set whose
+// slots all become free again when the stamp moves on
+static uintptr_t *seenLines;
+static unsigned *seenStamps;
+static unsigned seenMask;
+static unsigned seenStamp;
+
+// Start a new set with room for 'count' lines
+static void
+lines_begin(unsigned count)
+{
+  unsigned size = 64;
+  while (size < 2 * count) {
+    size *= 2;
   }
-  if (choices){
-    free(choices);
+  if (!seenLines || size > seenMask + 1) {
+    free(seenLines);
+    free(seenStamps);
+    seenLines = malloc(size * sizeof(uintptr_t));
+    seenStamps = calloc(size, sizeof(unsigned));
+    seenMask = size - 1;
+    seenStamp = 0;
   }
-  if (lhistories){
-    free(lhistories);
+  if (++seenStamp == 0) {
+    memset(seenStamps, 0, (seenMask + 1) * sizeof(unsigned));
+    seenStamp = 1;
   }
-  if (lpredict){
-    free(lpredict);
+}
+
+// Add the lines of the 'bytes' long table slice at 'p'. Returns how many of
+// them were not in the set yet.
+static int
+lines_add(const void *p, size_t bytes)
+{
+  uintptr_t first = (uintptr_t)p & ~(uintptr_t)(ARENA_ALIGN - 1);
+  uintptr_t last = ((uintptr_t)p + bytes - 1) & ~(uintptr_t)(ARENA_ALIGN - 1);
+  int added = 0;
+  for (uintptr_t line = first; line <= last; line += ARENA_ALIGN) {
+    unsigned slot = (unsigned)(line / ARENA_ALIGN * 2654435761u) & seenMask;
+    while (seenStamps[slot] == seenStamp && seenLines[slot] != line) {
+      slot = (slot + 1) & seenMask;
+    }
+    if (seenStamps[slot] != seenStamp) {
+      seenStamps[slot] = seenStamp;
+      seenLines[slot] = line;
+      added++;
+    }
   }
+  return added;
+}
 
-  // Custom Perceptron
-  // Table of perceptron arrays that are bias + weights
-  if (perceptrons){
-    for (int i = 0; i < psize; i++) {
-      free(perceptrons[i]);
+// Number of distinct table cache lines make_prediction() and
+// train_predictor() will touch for the branch at 'pc' with 'outcome'; call
+// it before either. The path predictor's short per-path arrays are left
+// out, every branch walks them. The denominator for prefetch coverage.
+//
+int
+predictor_lines(uint32_t pc, uint8_t outcome)
+{
+  switch (bpType) {
+    case GSHARE:
+      lines_begin(1);
+      return lines_add(&bht[(pc ^ ghistory) & mask], sizeof(int));
+    case TOURNAMENT: {
+      int ghistoryIndex = ghistory & mask;
+      int lhIndex = pc & lhmask;
+      lines_begin(4);
+      return lines_add(&choices[ghistoryIndex], sizeof(int)) +
+             lines_add(&global[ghistoryIndex], sizeof(int)) +
+             lines_add(&lhistories[lhIndex], sizeof(unsigned)) +
+             lines_add(&lpredict[lhistories[lhIndex] & lpmask], sizeof(int));
     }
-    free(perceptrons);
+    case CUSTOM:
+      if (customType == 0){
+        int lhIndex = pc & lhmask;
+        lines_begin(4);
+        return lines_add(&choices[pc & mask], sizeof(int)) +
+               lines_add(&global[ghistory & mask], sizeof(int)) +
+               lines_add(&lhistories[lhIndex], sizeof(unsigned)) +
+               lines_add(&lpredict[lhistories[lhIndex] & lpmask], sizeof(int));
+      }
+      else if (customType == 1){
+        // Both the lookup and the training walk the whole row
+        lines_begin(4);
+        return lines_add(perceptrons[pc & pmask],
+                         (ghistoryBits + 1) * sizeof(int));
+      }
+      else if (customType == 2){
+        int* weights = &pathWeights[(size_t)(pc & pmask) * (pathLength + 1)];
+        size_t rowBytes = (pathLength + 1) * sizeof(int);
+        lines_begin(rowBytes / ARENA_ALIGN + 2 + pathLength);
+        int lines = lines_add(weights, rowBytes);
+
+        // A trained branch also bumps one weight in each row along the path
+        int sum = pathSums[pathLength] + weights[0];
+        uint8_t prediction = sum < 0 ? NOTTAKEN : TAKEN;
+        if (prediction != outcome || abs(sum) <= threshold){
+          for (int j = 1; j <= pathLength; j++) {
+            lines += lines_add(&pathWeights[(size_t)pathRows[j] *
+                                            (pathLength + 1) + j], sizeof(int));
+          }
+        }
+        return lines;
+      }
+      return 0;
+    default:
+      return 0;
   }
+}
+
+void clean_predictor(){
+  // Free all the data structures you created, they all share one mapping
+  arena_release(&tables);
+
+  // Forget the freed tables so a later init/clean starts from a clean slate
+  bht = NULL;
+  global = NULL;
+  choices = NULL;
+  lhistories = NULL;
+  lpredict = NULL;
+  perceptrons = NULL;
+  pathWeights = NULL;
+  pathSums = NULL;
+  pathRows = NULL;
+  pathOutcomes = NULL;
+  filter = NULL;
+
+  free(seenLines);
+  free(seenStamps);
+  seenLines = NULL;
+  seenStamps = NULL;
+
+  // Held back updates would point into the released tables
+  free(pending);
+  pending = NULL;
+  numPending = 0;
+  pendingCap = 0;
+  delayedBranches = 0;
 
   return;
 }
+
+// Print where each table of the current predictor lives
+void
+print_predictor_layout(FILE *out)
+{
+  arena_report(out, &tables);
+}
+
+// Hardware view of the tables: 2-bit counters, history registers as wide
+// as the history and 8-bit weights, where the simulator uses plain ints
+void
+describe_predictor(cost_design *d)
+{
+  memset(d, 0, sizeof(*d));
+
+  switch (bpType) {
+    case GSHARE:
+      cost_add_table(d, "bht", 1u << ghistoryBits, 2, 0);
+      break;
+    case TOURNAMENT:
+    case CUSTOM:
+      if (bpType == TOURNAMENT || customType == 0){
+        // The local pattern table is indexed by a local history read first
+        cost_add_table(d, "choices", (uint64_t)gsize, 2, 0);
+        cost_add_table(d, "global", (uint64_t)gsize, 2, 0);
+        cost_add_table(d, "lhistories", (uint64_t)lhsize, lhistoryBits, 0);
+        cost_add_table(d, "lpredict", (uint64_t)lpsize, 2, 1);
+        d->muxInputs = 2;
+      }
+      else if (customType == 1){
+        // One row of bias + weights, summed by an adder tree
+        cost_add_table(d, "perceptrons", psize, (ghistoryBits + 1) * 8, 0);
+        d->adderInputs = ghistoryBits + 1;
+        d->adderWidth = 8;
+      }
+      else if (customType == 2){
+        // The history part of the sum was computed ahead in pathSums
+        // (flip-flops, not modelled), only the bias is added; the rest of
+        // the row updates the partial sums
+        cost_add_table(d, "pathWeights", psize, (pathLength + 1) * 8, 0);
+        d->adderInputs = 2;
+        d->adderWidth = 16;
+      }
+      break;
+    default:
+      break;
+  }
+
+  // The filter is read alongside and wins when it is confident
+  if (filter) {
+    cost_add_table(d, "filter", 1u << filterBits, 32 + 1 + 8, 0);
+    d->muxInputs = d->muxInputs ? d->muxInputs + 1 : 2;
+  }
+}
+
+// How many branches the bias filter answered, and how many of those wrongly
+void
+filter_stats(uint64_t *filtered, uint64_t *misses)
+{
+  *filtered = filteredBranches;
+  *misses = filterMisses;
+}
+
+void
+filter_clear_stats()
+{
+  filteredBranches = 0;
+  filterMisses = 0;
+}
+
+//------------------------------------//
+//      Predictor State Snapshots     //
+//------------------------------------//
+
+// Every global that makes up one predictor instance. The library front-end
+// (bpredictor.c) swaps these in and out so several predictors can live in
+// one process without touching the code above.
+typedef struct {
+  arena tables;
+
+  int ghistoryBits;
+  int lhistoryBits;
+  int pcIndexBits;
+  int bpType;
+  int customType;
+
+  unsigned ghistory;
+  unsigned mask;
+  int bhtBits;
+  int* bht;
+
+  int gsize;
+  int* global;
+  unsigned lhmask;
+  int lhsize;
+  unsigned* lhistories;
+  unsigned lpmask;
+  int lpsize;
+  int* lpredict;
+  int* choices;
+
+  int pmask;
+  int psize;
+  int threshold;
+  int** perceptrons;
+
+  int pathLength;
+  int* pathWeights;
+  int* pathSums;
+  int* pathRows;
+  uint8_t* pathOutcomes;
+
+  int filterBits;
+  int filterConfidence;
+  unsigned filterMask;
+  filter_entry* filter;
+  uint64_t filteredBranches;
+  uint64_t filterMisses;
+
+  int updateDelay;
+  pending_update* pending;
+  unsigned numPending;
+  unsigned pendingCap;
+  int delayedBranches;
+} predictor_state;
+
+size_t
+predictor_state_size()
+{
+  return sizeof(predictor_state);
+}
+
+void
+save_predictor_state(void *dst)
+{
+  predictor_state *s = dst;
+
+  s->tables = tables;
+
+  s->ghistoryBits = ghistoryBits;
+  s->lhistoryBits = lhistoryBits;
+  s->pcIndexBits = pcIndexBits;
+  s->bpType = bpType;
+  s->customType = customType;
+
+  s->ghistory = ghistory;
+  s->mask = mask;
+  s->bhtBits = bhtBits;
+  s->bht = bht;
+
+  s->gsize = gsize;
+  s->global = global;
+  s->lhmask = lhmask;
+  s->lhsize = lhsize;
+  s->lhistories = lhistories;
+  s->lpmask = lpmask;
+  s->lpsize = lpsize;
+  s->lpredict = lpredict;
+  s->choices = choices;
+
+  s->pmask = pmask;
+  s->psize = psize;
+  s->threshold = threshold;
+  s->perceptrons = perceptrons;
+
+  s->pathLength = pathLength;
+  s->pathWeights = pathWeights;
+  s->pathSums = pathSums;
+  s->pathRows = pathRows;
+  s->pathOutcomes = pathOutcomes;
+
+  s->filterBits = filterBits;
+  s->filterConfidence = filterConfidence;
+  s->filterMask = filterMask;
+  s->filter = filter;
+  s->filteredBranches = filteredBranches;
+  s->filterMisses = filterMisses;
+
+  s->updateDelay = updateDelay;
+  s->pending = pending;
+  s->numPending = numPending;
+  s->pendingCap = pendingCap;
+  s->delayedBranches = delayedBranches;
+}
+
+void
+load_predictor_state(const void *src)
+{
+  const predictor_state *s = src;
+
+  tables = s->tables;
+
+  ghistoryBits = s->ghistoryBits;
+  lhistoryBits = s->lhistoryBits;
+  pcIndexBits = s->pcIndexBits;
+  bpType = s->bpType;
+  customType = s->customType;
+
+  ghistory = s->ghistory;
+  mask = s->mask;
+  bhtBits = s->bhtBits;
+  bht = s->bht;
+
+  gsize = s->gsize;
+  global = s->global;
+  lhmask = s->lhmask;
+  lhsize = s->lhsize;
+  lhistories = s->lhistories;
+  lpmask = s->lpmask;
+  lpsize = s->lpsize;
+  lpredict = s->lpredict;
+  choices = s->choices;
+
+  pmask = s->pmask;
+  psize = s->psize;
+  threshold = s->threshold;
+  perceptrons = s->perceptrons;
+
+  pathLength = s->pathLength;
+  pathWeights = s->pathWeights;
+  pathSums = s->pathSums;
+  pathRows = s->pathRows;
+  pathOutcomes = s->pathOutcomes;
+
+  filterBits = s->filterBits;
+  filterConfidence = s->filterConfidence;
+  filterMask = s->filterMask;
+  filter = s->filter;
+  filteredBranches = s->filteredBranches;
+  filterMisses = s->filterMisses;
+
+  updateDelay = s->updateDelay;
+  pending = s->pending;
+  numPending = s->numPending;
+  pendingCap = s->pendingCap;
+  delayedBranches = s->delayedBranches;
+}
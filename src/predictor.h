@@ -10,7 +10,10 @@
 #define PREDICTOR_H
 
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include "arena.h"
+#include "costmodel.h"
 
 //
 // Student Information
@@ -38,6 +41,9 @@ extern const char *bpName[];
 #define WT  2			// predict T, weak taken, 10
 #define ST  3			// predict T, strong taken, 11
 
+// Default run length after which the bias filter answers a branch itself
+#define FILTER_CONFIDENCE  16
+
 //------------------------------------//
 //      Predictor Configuration       //
 //------------------------------------//
@@ -47,14 +53,20 @@ extern int pcIndexBits;  // Number of bits used for PC index
 extern int bpType;       // Branch Prediction Type
 extern int verbose;
 extern int customType;   // For selecting which custom predictor I want to use
+extern int tablePages;   // ARENA_* page backing for the predictor tables
+extern int tableNuma;    // Bind the tables to the local NUMA node
+extern int filterBits;   // Bias filter index bits, 0 = no filter
+extern int filterConfidence; // Run length that settles a branch in the filter
+extern int updateDelay;  // Apply table updates in batches every this many branches
 
 //------------------------------------//
 //    Predictor Function Prototypes   //
 //------------------------------------//
 
-// Initialize the predictor
+// Initialize the predictor. Returns 0 on success and -1 if its tables
+// cannot be allocated; the predictor is then left without tables.
 //
-void init_predictor();
+int init_predictor();
 
 // Make a prediction for conditional branch instruction at PC 'pc'
 // Returning TAKEN indicates a prediction of taken; returning NOTTAKEN
@@ -71,4 +83,40 @@ void train_predictor(uint32_t pc, uint8_t outcome);
 // Clean up the data structures for the predictor
 void clean_predictor();
 
+// Prefetch the table lines a future lookup and training of 'pc' will touch,
+// given the global history (newest outcome in bit 0) at that point. Returns
+// the number of cache lines prefetched.
+//
+int prefetch_predictor(uint32_t pc, unsigned history);
+
+// Number of distinct table cache lines predicting and training the next
+// branch, at 'pc' with 'outcome', will touch
+//
+int predictor_lines(uint32_t pc, uint8_t outcome);
+
+// Print the offsets and sizes of the predictor tables and their page backing
+//
+void print_predictor_layout(FILE *out);
+
+// Describe the tables of the configured predictor as hardware would size
+// them, for the cost model
+//
+void describe_predictor(cost_design *d);
+
+// Branches the bias filter answered, and how many of them it mispredicted
+//
+void filter_stats(uint64_t *filtered, uint64_t *misses);
+
+// Start counting the bias filter's answers and misses from zero again
+//
+void filter_clear_stats();
+
+// Snapshot and restore every predictor global (configuration, histories
+// and table pointers) into an opaque buffer of predictor_state_size() bytes.
+// An all-zero buffer is a valid "nothing allocated" state.
+//
+size_t predictor_state_size();
+void save_predictor_state(void *dst);
+void load_predictor_state(const void *src);
+
 #endif
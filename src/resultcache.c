@@ -0,0 +1,256 @@
+//========================================================//
+//  resultcache.c                                         //
+//  On-disk cache of simulation results                   //
+//                                                        //
+//  One small text file per result, named by its 64-bit   //
+//  FNV-1a key, in $BP_CACHE_DIR or ~/.cache/bpredictor.  //
+//  Files are written under a temporary name and renamed  //
+//  into place, so concurrent runs never see half a file. //
+//  Hit and miss totals are kept in a "stats" file.       //
+//========================================================//
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "resultcache.h"
+
+// Checksum of the sources that determine the statistics, set by the Makefile
+#ifndef SIM_FINGERPRINT
+#define SIM_FINGERPRINT "unknown"
+#endif
+
+// Bumped when the stored format or the meaning of a result changes
+#define CACHE_FORMAT  1
+
+#define FNV_OFFSET  0xcbf29ce484222325ULL
+#define FNV_PRIME   0x100000001b3ULL
+
+static uint64_t
+fnv1a(uint64_t h, const void *data, size_t n)
+{
+  const uint8_t *p = data;
+  for (size_t i = 0; i < n; i++) {
+    h = (h ^ p[i]) * FNV_PRIME;
+  }
+  return h;
+}
+
+// Directory holding the cache, created on first use. Returns NULL if it
+// cannot be created.
+//
+static const char *
+cache_dir()
+{
+  static char dir[4096];
+  if (dir[0]) {
+    return dir;
+  }
+
+  const char *env = getenv("BP_CACHE_DIR");
+  const char *xdg = getenv("XDG_CACHE_HOME");
+  const char *home = getenv("HOME");
+  if (env && *env) {
+    snprintf(dir, sizeof(dir), "%s", env);
+  } else if (xdg && *xdg) {
+    snprintf(dir, sizeof(dir), "%s/bpredictor", xdg);
+  } else if (home && *home) {
+    snprintf(dir, sizeof(dir), "%s/.cache/bpredictor", home);
+  } else {
+    return NULL;
+  }
+
+  // mkdir -p
+  for (char *s = dir + 1; ; s++) {
+    if (*s == '/' || !*s) {
+      char c = *s;
+      *s = '\0';
+      if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        dir[0] = '\0';
+        return NULL;
+      }
+      *s = c;
+      if (!c) {
+        break;
+      }
+    }
+  }
+  return dir;
+}
+
+// Add one to the hit or miss total
+//
+static void
+count(int hit)
+{
+  const char *dir = cache_dir();
+  if (!dir) {
+    return;
+  }
+  char path[4200];
+  snprintf(path, sizeof(path), "%s/stats", dir);
+  int fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (fd < 0) {
+    return;
+  }
+
+  // Several runs may finish at once
+  flock(fd, LOCK_EX);
+  char buf[64] = "";
+  unsigned long long hits = 0, misses = 0;
+  ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+  if (n > 0) {
+    buf[n] = '\0';
+    sscanf(buf, "%llu %llu", &hits, &misses);
+  }
+  if (hit) {
+    hits++;
+  } else {
+    misses++;
+  }
+  n = snprintf(buf, sizeof(buf), "%llu %llu\n", hits, misses);
+  if (ftruncate(fd, 0) == 0 && pwrite(fd, buf, n, 0) != n) {
+    // Lost one count, nothing to do about it
+  }
+  flock(fd, LOCK_UN);
+  close(fd);
+}
+
+int
+result_cache_key(const char *path, const char *config, uint64_t *key)
+{
+  int fd = open(path, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    if (fd >= 0) {
+      close(fd);
+    }
+    return -1;
+  }
+
+  // The trace as stored, so a recompressed trace is a different trace
+  uint64_t h = FNV_OFFSET;
+  if (st.st_size > 0) {
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+      close(fd);
+      return -1;
+    }
+    h = fnv1a(h, map, st.st_size);
+    munmap(map, st.st_size);
+  }
+  close(fd);
+
+  char header[128];
+  int n = snprintf(header, sizeof(header), "\nformat %d sources %s\n",
+                   CACHE_FORMAT, SIM_FINGERPRINT);
+  h = fnv1a(h, header, n);
+  *key = fnv1a(h, config, strlen(config));
+  return 0;
+}
+
+int
+result_cache_get(uint64_t key, cached_result *r)
+{
+  const char *dir = cache_dir();
+  if (!dir) {
+    return 0;
+  }
+  char path[4200];
+  snprintf(path, sizeof(path), "%s/%016llx", dir, (unsigned long long)key);
+
+  FILE *f = fopen(path, "r");
+  unsigned long long v[4];
+  int hit = f && fscanf(f, "%llu %llu %llu %llu", &v[0], &v[1], &v[2],
+                        &v[3]) == 4;
+  if (f) {
+    fclose(f);
+  }
+  count(hit);
+  if (!hit) {
+    return 0;
+  }
+
+  r->branches = v[0];
+  r->mispredictions = v[1];
+  r->filtered = v[2];
+  r->filterMisses = v[3];
+  return 1;
+}
+
+void
+result_cache_put(uint64_t key, const cached_result *r)
+{
+  const char *dir = cache_dir();
+  if (!dir) {
+    return;
+  }
+  char path[4200], tmp[4300];
+  snprintf(path, sizeof(path), "%s/%016llx", dir, (unsigned long long)key);
+  snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path, (int)getpid());
+
+  FILE *f = fopen(tmp, "w");
+  if (!f) {
+    return;
+  }
+  fprintf(f, "%llu %llu %llu %llu\n", (unsigned long long)r->branches,
+          (unsigned long long)r->mispredictions,
+          (unsigned long long)r->filtered,
+          (unsigned long long)r->filterMisses);
+  if (fclose(f) != 0 || rename(tmp, path) != 0) {
+    unlink(tmp);
+  }
+}
+
+void
+result_cache_report(FILE *out)
+{
+  const char *dir = cache_dir();
+  if (!dir) {
+    fprintf(out, "Result cache: no cache directory (set BP_CACHE_DIR)\n");
+    return;
+  }
+
+  // Every 16 hex digit name is a result
+  unsigned long long entries = 0, bytes = 0;
+  DIR *d = opendir(dir);
+  struct dirent *e;
+  while (d && (e = readdir(d))) {
+    if (strlen(e->d_name) != 16 ||
+        strspn(e->d_name, "0123456789abcdef") != 16) {
+      continue;
+    }
+    char path[4200];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+    if (stat(path, &st) == 0) {
+      entries++;
+      bytes += st.st_size;
+    }
+  }
+  if (d) {
+    closedir(d);
+  }
+
+  unsigned long long hits = 0, misses = 0;
+  char path[4200];
+  snprintf(path, sizeof(path), "%s/stats", dir);
+  FILE *f = fopen(path, "r");
+  if (f) {
+    if (fscanf(f, "%llu %llu", &hits, &misses) != 2) {
+      hits = misses = 0;
+    }
+    fclose(f);
+  }
+
+  fprintf(out, "Result cache: %s\n", dir);
+  fprintf(out, "  %llu results, %llu bytes\n", entries, bytes);
+  fprintf(out, "  %llu hits, %llu misses (%.1f%% hit rate)\n", hits, misses,
+          hits + misses ? 100.0 * hits / (hits + misses) : 0.0);
+  fprintf(out, "  sources fingerprint %s\n", SIM_FINGERPRINT);
+}
@@ -0,0 +1,44 @@
+//========================================================//
+//  resultcache.h                                         //
+//  On-disk cache of simulation results                   //
+//                                                        //
+//  Results are stored under a hash of the trace bytes,   //
+//  the predictor configuration and a fingerprint of the  //
+//  simulator sources, so a rerun of an unchanged (trace, //
+//  configuration) pair is answered without simulating.   //
+//========================================================//
+
+#ifndef RESULTCACHE_H
+#define RESULTCACHE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Statistics of one run
+typedef struct {
+  uint64_t branches;
+  uint64_t mispredictions;
+  uint64_t filtered;        // Branches answered by the bias filter
+  uint64_t filterMisses;
+} cached_result;
+
+// Compute the key of a run of the trace at 'path' with the configuration
+// described by 'config' (every option that can change the statistics).
+// Returns 0 on success, -1 if the trace cannot be read.
+//
+int result_cache_key(const char *path, const char *config, uint64_t *key);
+
+// Look up a key. Returns 1 and fills in 'r' on a hit, 0 on a miss.
+//
+int result_cache_get(uint64_t key, cached_result *r);
+
+// Store the result of a run. Failures are silently ignored, the cache is
+// only an optimization.
+//
+void result_cache_put(uint64_t key, const cached_result *r);
+
+// Print the location, size and hit rate of the cache
+//
+void result_cache_report(FILE *out);
+
+#endif
@@ -0,0 +1,102 @@
+//========================================================//
+//  sweep.c                                               //
+//  One-pass sweep over predictor table sizes             //
+//                                                        //
+//  gshare with n history bits indexes its table with the //
+//  low n bits of pc ^ history, so every size can be      //
+//  indexed from the same value. Laying the tables out    //
+//  smallest first keeps the small ones in cache while    //
+//  only the largest few miss.                            //
+//========================================================//
+#include <math.h>
+#include <string.h>
+#include "predictor.h"
+#include "sweep.h"
+
+// Next state of a 2-bit counter, by [counter][outcome]
+static const uint8_t step[4][2] = {
+  { SN, WN }, { SN, WT }, { WN, ST }, { WT, ST },
+};
+
+int
+sweep_init(sweep *s, int maxBits, int pages)
+{
+  memset(s, 0, sizeof(*s));
+  if (maxBits < 1 || maxBits > SWEEP_MAX_BITS) {
+    return -1;
+  }
+  s->maxBits = maxBits;
+
+  // Table n occupies [2^n, 2^(n+1)), the first two bytes are unused
+  size_t size = (size_t)2 << maxBits;
+  arena_request requests[] = {
+    { "gshare", (void**)&s->gshare, size },
+    { "global", (void**)&s->global, size },
+  };
+  if (arena_create(&s->mem, requests, 2, pages, 0) != 0) {
+    return -1;
+  }
+
+  // Same starting point as the real predictors
+  memset(s->gshare, WN, size);
+  memset(s->global, WN, size);
+  return 0;
+}
+
+void
+sweep_branch(sweep *s, uint32_t pc, uint8_t outcome)
+{
+  uint32_t gshareIndex = pc ^ s->history;
+  uint32_t globalIndex = s->history;
+
+  // The sizes don't depend on each other, so the out-of-order core can
+  // overlap the cache misses of the large tables
+  for (int n = 1; n <= s->maxBits; n++) {
+    uint32_t base = 1u << n;
+    uint8_t *g = &s->gshare[base + (gshareIndex & (base - 1))];
+    uint8_t *h = &s->global[base + (globalIndex & (base - 1))];
+    s->gshareMisses[n] += (*g >> 1) ^ outcome;
+    s->globalMisses[n] += (*h >> 1) ^ outcome;
+    *g = step[*g][outcome];
+    *h = step[*h][outcome];
+  }
+
+  s->history = (s->history << 1) | outcome;
+  s->branches++;
+}
+
+void
+sweep_report(FILE *out, const sweep *s, double ghz)
+{
+  fprintf(out, "Branches:        %10llu\n", (unsigned long long)s->branches);
+  fprintf(out, "Misprediction rate by history length (gshare, and the "
+               "tournament's global table on its own):\n");
+  fprintf(out, "  bits     entries    gshare    global%s\n",
+          ghz ? "  latency ps  cycles" : "");
+  for (int n = 1; n <= s->maxBits; n++) {
+    double branches = s->branches ? (double)s->branches : 1.0;
+    fprintf(out, "  %4d  %10lu   %7.3f   %7.3f", n, 1UL << n,
+            100 * s->gshareMisses[n] / branches,
+            100 * s->globalMisses[n] / branches);
+
+    // Both tables are 2^n 2-bit counters
+    if (ghz) {
+      cost_design d;
+      cost_estimate e;
+      memset(&d, 0, sizeof(d));
+      cost_add_table(&d, "bht", 1UL << n, 2, 0);
+      cost_design_estimate(&d, &e);
+      fprintf(out, "  %10.1f  %6d", e.latency,
+              (int)ceil(e.latency * ghz / 1000));
+    }
+    fprintf(out, "\n");
+  }
+}
+
+void
+sweep_free(sweep *s)
+{
+  arena_release(&s->mem);
+  s->gshare = NULL;
+  s->global = NULL;
+}
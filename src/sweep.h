@@ -0,0 +1,51 @@
+//========================================================//
+//  sweep.h                                               //
+//  One-pass sweep over predictor table sizes             //
+//                                                        //
+//  Simulates gshare and the global-history table of the  //
+//  tournament predictor at every history length up to a  //
+//  limit in a single pass over the trace.                //
+//========================================================//
+
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "arena.h"
+
+// Largest history length a sweep can cover; each of the two sets of
+// tables then takes 2^(SWEEP_MAX_BITS + 1) bytes
+#define SWEEP_MAX_BITS  28
+
+typedef struct {
+  int maxBits;
+  unsigned history;     // Global history, newest outcome in bit 0
+
+  // Byte counters of every size, table n at offset 2^n
+  uint8_t *gshare;      // Indexed by (pc ^ history) & (2^n - 1)
+  uint8_t *global;      // Indexed by history & (2^n - 1)
+  arena mem;
+
+  uint64_t branches;
+  uint64_t gshareMisses[SWEEP_MAX_BITS + 1];
+  uint64_t globalMisses[SWEEP_MAX_BITS + 1];
+} sweep;
+
+// Set up the tables for history lengths 1..'maxBits', using 'pages'
+// (ARENA_*) for the counters. Returns 0 on success.
+//
+int sweep_init(sweep *s, int maxBits, int pages);
+
+// Predict and train every size with one branch
+//
+void sweep_branch(sweep *s, uint32_t pc, uint8_t outcome);
+
+// Print the misprediction rate of every size, and with a clock of 'ghz'
+// (0 = none) the cost model's access latency of its table
+//
+void sweep_report(FILE *out, const sweep *s, double ghz);
+
+void sweep_free(sweep *s);
+
+#endif
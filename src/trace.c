@@ -0,0 +1,692 @@
+//========================================================//
+//  trace.c                                               //
+//  Branch trace reader                                   //
+//                                                        //
+//  A .bz2 trace is mapped into memory and scanned for    //
+//  the 48-bit block magics. Each block is then turned    //
+//  into a standalone single-block bzip2 stream (the      //
+//  same trick bzip2recover uses) and decompressed with   //
+//  libbz2, so reading can begin at any block. Blocks     //
+//  are independent, so a pool of threads can decode the  //
+//  ones ahead of the reader while it parses this one.    //
+//========================================================//
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <bzlib.h>
+#include "trace.h"
+
+#define BZ2_BLOCK_MAGIC  0x314159265359ULL
+#define BZ2_EOS_MAGIC    0x177245385090ULL
+#define BZ2_MAGIC_MASK   0xffffffffffffULL
+
+// Bytes read from a plain trace at a time
+#define PLAIN_CHUNK  (1 << 16)
+
+// Blocks decoded ahead of the reader per decoding thread
+#define BLOCKS_AHEAD  2
+
+// Decoder threads for .bz2 traces opened from now on
+static int decodeThreads = 1;
+
+typedef struct {
+  uint64_t start;   // Bit offset of the block magic
+  uint64_t end;     // Bit offset of the following block or end-of-stream magic
+  char level;       // Block size digit of the enclosing stream ('1'..'9')
+} bz2_block;
+
+// A decoded block waiting in the pool
+typedef struct {
+  size_t block;     // Block held (or being decoded) when not SLOT_FREE
+  int state;
+  int error;
+  char *data;
+  size_t len;
+  size_t cap;
+} bz2_slot;
+
+#define SLOT_FREE  0
+#define SLOT_BUSY  1   // Claimed by a decoder thread
+#define SLOT_DONE  2
+
+// Decoder threads working up to 'numSlots' blocks ahead of the reader.
+// Block k always goes to slot k % numSlots, which is free again once the
+// reader has consumed block k - numSlots.
+typedef struct {
+  pthread_t *threads;
+  int numThreads;
+  bz2_slot *slots;
+  size_t numSlots;
+  size_t nextClaim;     // Next block a thread may pick up
+  size_t consumed;      // Blocks before this one have been handed out
+  int busy;             // Slots in SLOT_BUSY
+  int quit;
+  pthread_mutex_t lock;
+  pthread_cond_t work;  // A block became claimable, or quit
+  pthread_cond_t done;  // A block finished decoding
+} bz2_pool;
+
+struct trace {
+  // Plain text source (NULL for .bz2)
+  FILE *stream;
+  uint64_t bufOffset;   // File offset of buf[0]
+
+  // Compressed source
+  const uint8_t *file;
+  size_t fileSize;
+  bz2_block *blocks;
+  size_t numBlocks;
+  size_t nextBlock;     // Next block to decode
+  size_t curBlock;      // Block whose data starts at buf[bufBase]
+  size_t bufBase;       // Bytes before this belong to block curBlock - 1
+  size_t curLen;        // Decoded length of block curBlock
+  size_t prevLen;       // Decoded length of block curBlock - 1
+  bz2_pool *pool;       // NULL when decoding on the reading thread
+
+  // Records are TRACE_BINARY_RECORD byte structs rather than text lines
+  int binary;
+
+  // Decoded data not yet consumed is buf[bufPos, bufLen)
+  char *buf;
+  size_t bufPos;
+  size_t bufLen;
+  size_t bufCap;
+};
+
+//------------------------------------//
+//        bzip2 Block Handling        //
+//------------------------------------//
+
+// Read 'n' (<= 57) bits starting at bit offset 'bit'
+//
+static uint64_t
+get_bits(const uint8_t *data, uint64_t bit, int n)
+{
+  uint64_t v = 0;
+  for (int i = 0; i < n; i++, bit++) {
+    v = (v << 1) | ((data[bit >> 3] >> (7 - (bit & 7))) & 1);
+  }
+  return v;
+}
+
+// Append the low 'n' bits of 'v' at bit offset '*bit' (buffer pre-zeroed)
+//
+static void
+put_bits(uint8_t *data, uint64_t *bit, uint64_t v, int n)
+{
+  for (int i = n - 1; i >= 0; i--, (*bit)++) {
+    if ((v >> i) & 1) {
+      data[*bit >> 3] |= 0x80 >> (*bit & 7);
+    }
+  }
+}
+
+// Locate every block of every stream in the file
+//
+static int
+scan_blocks(trace *t)
+{
+  const uint8_t *f = t->file;
+  if (t->fileSize < 4 || f[0] != 'B' || f[1] != 'Z' || f[2] != 'h' ||
+      f[3] < '1' || f[3] > '9') {
+    return -1;
+  }
+
+  size_t cap = 64;
+  t->blocks = malloc(cap * sizeof(bz2_block));
+  t->numBlocks = 0;
+
+  char level = f[3];
+  uint64_t w = 0;
+  for (size_t i = 4; i < t->fileSize; i++) {
+    for (int b = 7; b >= 0; b--) {
+      w = (w << 1) | ((f[i] >> b) & 1);
+      uint64_t tail = w & BZ2_MAGIC_MASK;
+      if (tail != BZ2_BLOCK_MAGIC && tail != BZ2_EOS_MAGIC) {
+        continue;
+      }
+
+      uint64_t bit = (uint64_t)i * 8 + (7 - b) + 1 - 48;
+      if (t->numBlocks && t->blocks[t->numBlocks-1].end == 0) {
+        t->blocks[t->numBlocks-1].end = bit;
+      }
+
+      if (tail == BZ2_BLOCK_MAGIC) {
+        if (t->numBlocks == cap) {
+          cap *= 2;
+          t->blocks = realloc(t->blocks, cap * sizeof(bz2_block));
+        }
+        t->blocks[t->numBlocks].start = bit;
+        t->blocks[t->numBlocks].end = 0;
+        t->blocks[t->numBlocks].level = level;
+        t->numBlocks++;
+      } else {
+        // A concatenated stream may follow the 32-bit stream CRC
+        size_t next = (bit + 48 + 32 + 7) / 8;
+        if (next + 4 <= t->fileSize && f[next] == 'B' && f[next+1] == 'Z' &&
+            f[next+2] == 'h') {
+          level = f[next+3];
+        }
+      }
+    }
+  }
+
+  // A truncated final block has no terminator
+  if (t->numBlocks && t->blocks[t->numBlocks-1].end == 0) {
+    t->numBlocks--;
+  }
+  return 0;
+}
+
+// Decompress block 'k' onto the end of the growable buffer 'buf'. Only
+// reads the mapped file and the block list, so any thread may call it.
+//
+static int
+decode_block(const trace *t, size_t k, char **buf, size_t *len, size_t *cap)
+{
+  const bz2_block *blk = &t->blocks[k];
+  uint64_t bits = blk->end - blk->start;
+
+  // "BZh<level>" + block + end-of-stream magic + stream CRC, byte padded
+  size_t size = 4 + (bits + 48 + 32 + 7) / 8;
+  uint8_t *stream = calloc(size, 1);
+  memcpy(stream, "BZh", 3);
+  stream[3] = blk->level;
+
+  // Shift the block into byte alignment
+  const uint8_t *src = t->file + (blk->start >> 3);
+  int shift = blk->start & 7;
+  size_t whole = bits / 8;
+  for (size_t j = 0; j < whole; j++) {
+    stream[4 + j] = (src[j] << shift) | (shift ? src[j+1] >> (8 - shift) : 0);
+  }
+  uint64_t bit = 32 + whole * 8;
+  put_bits(stream, &bit, get_bits(t->file, blk->start + whole * 8, bits % 8),
+           bits % 8);
+
+  // With a single block the stream CRC equals the block CRC
+  put_bits(stream, &bit, BZ2_EOS_MAGIC, 48);
+  put_bits(stream, &bit, get_bits(t->file, blk->start + 48, 32), 32);
+
+  bz_stream bz;
+  memset(&bz, 0, sizeof(bz));
+  if (BZ2_bzDecompressInit(&bz, 0, 0) != BZ_OK) {
+    free(stream);
+    return -1;
+  }
+  bz.next_in = (char *)stream;
+  bz.avail_in = size;
+
+  int ret;
+  do {
+    if (*cap - *len < PLAIN_CHUNK) {
+      *cap = *cap * 2 + PLAIN_CHUNK;
+      *buf = realloc(*buf, *cap);
+    }
+    bz.next_out = *buf + *len;
+    bz.avail_out = *cap - *len;
+    ret = BZ2_bzDecompress(&bz);
+    *len = *cap - bz.avail_out;
+    // Out of input with room to spare: the block is truncated
+    if (ret == BZ_OK && bz.avail_in == 0 && bz.avail_out > 0) {
+      ret = BZ_UNEXPECTED_EOF;
+    }
+  } while (ret == BZ_OK);
+
+  BZ2_bzDecompressEnd(&bz);
+  free(stream);
+  return ret == BZ_STREAM_END ? 0 : -1;
+}
+
+//------------------------------------//
+//         Parallel Decoding          //
+//------------------------------------//
+
+// Decoder thread: claim the next block within reach and decode it into
+// its slot, until the pool shuts down
+//
+static void *
+pool_worker(void *arg)
+{
+  trace *t = arg;
+  bz2_pool *p = t->pool;
+
+  pthread_mutex_lock(&p->lock);
+  while (1) {
+    while (!p->quit && (p->nextClaim >= t->numBlocks ||
+                        p->nextClaim >= p->consumed + p->numSlots)) {
+      pthread_cond_wait(&p->work, &p->lock);
+    }
+    if (p->quit) {
+      break;
+    }
+
+    size_t k = p->nextClaim++;
+    bz2_slot *slot = &p->slots[k % p->numSlots];
+    slot->block = k;
+    slot->state = SLOT_BUSY;
+    p->busy++;
+    pthread_mutex_unlock(&p->lock);
+
+    // The slot belongs to this thread until it is marked done
+    slot->len = 0;
+    slot->error = decode_block(t, k, &slot->data, &slot->len, &slot->cap);
+
+    pthread_mutex_lock(&p->lock);
+    slot->state = SLOT_DONE;
+    p->busy--;
+    pthread_cond_broadcast(&p->done);
+  }
+  pthread_mutex_unlock(&p->lock);
+  return NULL;
+}
+
+// Start 'n' decoder threads. Returns -1 (and decodes serially) on failure.
+//
+static int
+pool_start(trace *t, int n)
+{
+  bz2_pool *p = calloc(1, sizeof(bz2_pool));
+  p->numSlots = (size_t)n * BLOCKS_AHEAD;
+  p->slots = calloc(p->numSlots, sizeof(bz2_slot));
+  p->threads = malloc(n * sizeof(pthread_t));
+  p->nextClaim = t->nextBlock;
+  p->consumed = t->nextBlock;
+  pthread_mutex_init(&p->lock, NULL);
+  pthread_cond_init(&p->work, NULL);
+  pthread_cond_init(&p->done, NULL);
+  t->pool = p;
+
+  for (; p->numThreads < n; p->numThreads++) {
+    if (pthread_create(&p->threads[p->numThreads], NULL, pool_worker, t)) {
+      break;
+    }
+  }
+  return p->numThreads ? 0 : -1;
+}
+
+// Stop and join the decoder threads and free the pool
+//
+static void
+pool_stop(trace *t)
+{
+  bz2_pool *p = t->pool;
+
+  pthread_mutex_lock(&p->lock);
+  p->quit = 1;
+  pthread_cond_broadcast(&p->work);
+  pthread_mutex_unlock(&p->lock);
+  for (int i = 0; i < p->numThreads; i++) {
+    pthread_join(p->threads[i], NULL);
+  }
+
+  for (size_t i = 0; i < p->numSlots; i++) {
+    free(p->slots[i].data);
+  }
+  pthread_mutex_destroy(&p->lock);
+  pthread_cond_destroy(&p->work);
+  pthread_cond_destroy(&p->done);
+  free(p->slots);
+  free(p->threads);
+  free(p);
+  t->pool = NULL;
+}
+
+// Throw away everything decoded ahead and restart the threads at block
+// 'k'. Blocks still being decoded are waited for, their slots are reused.
+//
+static void
+pool_restart(trace *t, size_t k)
+{
+  bz2_pool *p = t->pool;
+
+  pthread_mutex_lock(&p->lock);
+  p->nextClaim = t->numBlocks;
+  while (p->busy) {
+    pthread_cond_wait(&p->done, &p->lock);
+  }
+  for (size_t i = 0; i < p->numSlots; i++) {
+    p->slots[i].state = SLOT_FREE;
+  }
+  p->consumed = k;
+  p->nextClaim = k;
+  pthread_cond_broadcast(&p->work);
+  pthread_mutex_unlock(&p->lock);
+}
+
+// Wait for block 'k', the next one in order, and append it to the text
+// buffer. Its slot is handed back to the threads for block k + numSlots.
+//
+static int
+pool_take(trace *t, size_t k)
+{
+  bz2_pool *p = t->pool;
+  bz2_slot *slot = &p->slots[k % p->numSlots];
+
+  pthread_mutex_lock(&p->lock);
+  while (slot->state != SLOT_DONE || slot->block != k) {
+    pthread_cond_wait(&p->done, &p->lock);
+  }
+  pthread_mutex_unlock(&p->lock);
+
+  int error = slot->error;
+  if (!error) {
+    if (t->bufCap - t->bufLen < slot->len) {
+      t->bufCap = t->bufLen + slot->len + PLAIN_CHUNK;
+      t->buf = realloc(t->buf, t->bufCap);
+    }
+    memcpy(t->buf + t->bufLen, slot->data, slot->len);
+    t->bufLen += slot->len;
+  }
+
+  pthread_mutex_lock(&p->lock);
+  slot->state = SLOT_FREE;
+  p->consumed = k + 1;
+  pthread_cond_broadcast(&p->work);
+  pthread_mutex_unlock(&p->lock);
+  return error;
+}
+
+//------------------------------------//
+//          Buffer Management         //
+//------------------------------------//
+
+// Append more decoded text to the buffer. Returns 0 at the end of input.
+//
+static int
+refill(trace *t)
+{
+  // Keep the unconsumed tail, it is the start of a split line
+  size_t keep = t->bufLen - t->bufPos;
+  memmove(t->buf, t->buf + t->bufPos, keep);
+  t->bufOffset += t->bufPos;
+  t->bufBase = t->bufBase > t->bufPos ? t->bufBase - t->bufPos : 0;
+  t->bufLen = keep;
+  t->bufPos = 0;
+
+  if (t->stream) {
+    if (t->bufCap - t->bufLen < PLAIN_CHUNK) {
+      t->bufCap = t->bufCap * 2 + PLAIN_CHUNK;
+      t->buf = realloc(t->buf, t->bufCap);
+    }
+    size_t got = fread(t->buf + t->bufLen, 1, t->bufCap - t->bufLen, t->stream);
+    t->bufLen += got;
+    return got > 0;
+  }
+
+  if (t->nextBlock >= t->numBlocks) {
+    return 0;
+  }
+
+  // The kept tail is the end of the current block
+  size_t before = t->bufLen;
+  int error = t->pool ? pool_take(t, t->nextBlock) :
+              decode_block(t, t->nextBlock, &t->buf, &t->bufLen, &t->bufCap);
+  if (error) {
+    fprintf(stderr, "trace: corrupt bzip2 block %zu\n", t->nextBlock);
+    t->bufLen = before;
+    t->nextBlock = t->numBlocks;
+    return 0;
+  }
+  t->prevLen = t->curLen;
+  t->curLen = t->bufLen - before;
+  t->curBlock = t->nextBlock++;
+  t->bufBase = before;
+  return 1;
+}
+
+// Parse one "<hex pc> <outcome>" line of 'n' bytes
+//
+static void
+parse_line(const char *s, size_t n, uint32_t *pc, uint8_t *outcome)
+{
+  size_t i = 0;
+  uint32_t v = 0;
+
+  if (n >= 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+    i = 2;
+  }
+  for (; i < n; i++) {
+    char c = s[i];
+    if (c >= '0' && c <= '9') {
+      v = (v << 4) | (c - '0');
+    } else if (c >= 'a' && c <= 'f') {
+      v = (v << 4) | (c - 'a' + 10);
+    } else if (c >= 'A' && c <= 'F') {
+      v = (v << 4) | (c - 'A' + 10);
+    } else {
+      break;
+    }
+  }
+  *pc = v;
+
+  while (i < n && (s[i] == ' ' || s[i] == '\t')) {
+    i++;
+  }
+  v = 0;
+  for (; i < n && s[i] >= '0' && s[i] <= '9'; i++) {
+    v = v * 10 + (s[i] - '0');
+  }
+  *outcome = v;
+}
+
+//------------------------------------//
+//          Public Interface          //
+//------------------------------------//
+
+// Look at the start of the data to tell binary traces from text
+//
+static void
+detect_format(trace *t)
+{
+  // A short first read from a pipe may not hold the whole magic yet
+  while (t->bufLen < 8 && refill(t)) {
+  }
+  if (t->bufLen >= 8 && !memcmp(t->buf, TRACE_BINARY_MAGIC, 8)) {
+    t->binary = 1;
+    t->bufPos = 8;
+  }
+}
+
+trace *
+trace_open(const char *path)
+{
+  trace *t = calloc(1, sizeof(trace));
+
+  size_t n = path ? strlen(path) : 0;
+  if (!path || n < 4 || strcmp(path + n - 4, ".bz2")) {
+    t->stream = path ? fopen(path, "r") : stdin;
+    if (!t->stream) {
+      fprintf(stderr, "trace: cannot open %s\n", path);
+      free(t);
+      return NULL;
+    }
+    detect_format(t);
+    return t;
+  }
+
+  int fd = open(path, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    fprintf(stderr, "trace: cannot open %s\n", path);
+    if (fd >= 0) {
+      close(fd);
+    }
+    free(t);
+    return NULL;
+  }
+
+  t->fileSize = st.st_size;
+  void *map = t->fileSize ? mmap(NULL, t->fileSize, PROT_READ, MAP_PRIVATE,
+                                 fd, 0) : MAP_FAILED;
+  close(fd);
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "trace: cannot map %s\n", path);
+    free(t);
+    return NULL;
+  }
+  t->file = map;
+
+  if (scan_blocks(t) != 0) {
+    fprintf(stderr, "trace: %s is not a bzip2 file\n", path);
+    trace_close(t);
+    return NULL;
+  }
+
+  // One block is all a single thread could have in flight anyway
+  if (decodeThreads > 1 && t->numBlocks > 1 && pool_start(t, decodeThreads)) {
+    pool_stop(t);
+  }
+  detect_format(t);
+  return t;
+}
+
+int
+trace_read(trace *t, uint32_t *pc, uint8_t *outcome)
+{
+  if (t->binary) {
+    while (t->bufLen - t->bufPos < TRACE_BINARY_RECORD) {
+      if (!refill(t)) {
+        return 0;
+      }
+    }
+    const uint8_t *r = (const uint8_t *)t->buf + t->bufPos;
+    *pc = r[0] | (r[1] << 8) | (r[2] << 16) | ((uint32_t)r[3] << 24);
+    *outcome = r[4];
+    t->bufPos += TRACE_BINARY_RECORD;
+    return 1;
+  }
+
+  while (1) {
+    char *start = t->buf + t->bufPos;
+    char *nl = t->bufPos < t->bufLen ?
+               memchr(start, '\n', t->bufLen - t->bufPos) : NULL;
+
+    if (!nl && refill(t)) {
+      continue;
+    }
+
+    size_t n = nl ? (size_t)(nl - start) : t->bufLen - t->bufPos;
+    if (!nl && n == 0) {
+      return 0;
+    }
+    t->bufPos += nl ? n + 1 : n;
+
+    // Blank lines (e.g. a trailing empty line) are not branches
+    if (n == 0 || (n == 1 && start[0] == '\r')) {
+      continue;
+    }
+    parse_line(start, n, pc, outcome);
+    return 1;
+  }
+}
+
+void
+trace_tell(trace *t, trace_pos *pos)
+{
+  if (t->stream) {
+    pos->offset = t->bufOffset + t->bufPos;
+    pos->skip = 0;
+    return;
+  }
+
+  // Everything decoded has been consumed: the next line starts a block
+  if (t->bufPos == t->bufLen && t->nextBlock < t->numBlocks) {
+    pos->offset = t->blocks[t->nextBlock].start;
+    pos->skip = 0;
+    return;
+  }
+
+  if (t->bufPos < t->bufBase && t->curBlock > 0) {
+    pos->offset = t->blocks[t->curBlock-1].start;
+    pos->skip = t->prevLen - (t->bufBase - t->bufPos);
+  } else if (t->numBlocks) {
+    pos->offset = t->blocks[t->curBlock].start;
+    pos->skip = t->bufPos - t->bufBase;
+  } else {
+    pos->offset = 0;
+    pos->skip = 0;
+  }
+}
+
+int
+trace_seek(trace *t, const trace_pos *pos)
+{
+  if (t->stream) {
+    if (t->stream == stdin || fseeko(t->stream, pos->offset, SEEK_SET) != 0) {
+      return -1;
+    }
+    t->bufOffset = pos->offset;
+    t->bufPos = 0;
+    t->bufLen = 0;
+    return 0;
+  }
+
+  // Find the block by its bit offset
+  size_t lo = 0, hi = t->numBlocks;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (t->blocks[mid].start < pos->offset) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo == t->numBlocks || t->blocks[lo].start != pos->offset) {
+    return -1;
+  }
+
+  t->bufPos = 0;
+  t->bufLen = 0;
+  t->bufBase = 0;
+  t->curLen = 0;
+  t->prevLen = 0;
+  t->curBlock = lo;
+  t->nextBlock = lo;
+  if (t->pool) {
+    pool_restart(t, lo);
+  }
+  if (!refill(t) || pos->skip > t->bufLen) {
+    return -1;
+  }
+  t->bufPos = pos->skip;
+  return 0;
+}
+
+void
+trace_set_threads(int threads)
+{
+  decodeThreads = threads > 0 ? threads : 1;
+}
+
+int
+trace_is_bz2(trace *t)
+{
+  return t->stream == NULL;
+}
+
+void
+trace_close(trace *t)
+{
+  if (!t) {
+    return;
+  }
+  if (t->stream && t->stream != stdin) {
+    fclose(t->stream);
+  }
+  if (t->pool) {
+    pool_stop(t);
+  }
+  if (t->file) {
+    munmap((void *)t->file, t->fileSize);
+  }
+  free(t->blocks);
+  free(t->buf);
+  free(t);
+}
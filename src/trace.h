@@ -0,0 +1,66 @@
+//========================================================//
+//  trace.h                                               //
+//  Branch trace reader                                   //
+//                                                        //
+//  Reads "<Address> <Outcome>" text traces or binary     //
+//  traces from stdin, plain files, or .bz2 files         //
+//  decompressed in-process one bzip2 block at a time,    //
+//  and can start reading at any record boundary          //
+//  recorded by trace_tell().                             //
+//========================================================//
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+typedef struct trace trace;
+
+// Binary traces start with these 8 bytes, followed by 5-byte records: the
+// PC as a little-endian uint32_t and the outcome byte (0 or 1)
+#define TRACE_BINARY_MAGIC   "BPTRACE1"
+#define TRACE_BINARY_RECORD  5
+
+// A record boundary. For plain traces 'offset' is the byte offset of the
+// line and 'skip' is 0. For .bz2 traces 'offset' is the bit offset of the
+// bzip2 block the line starts in and 'skip' is the number of decompressed
+// bytes of that block before the line.
+typedef struct {
+  uint64_t offset;
+  uint32_t skip;
+} trace_pos;
+
+// Open 'path' for reading, or stdin when 'path' is NULL. Files ending in
+// ".bz2" are decompressed in-process. Text or binary format is detected
+// from the first bytes. Returns NULL (with a message on stderr) if the file
+// cannot be opened or is not a valid bzip2 file.
+//
+trace *trace_open(const char *path);
+
+// Read the next record. Returns 1 on success and 0 at the end of the trace.
+//
+int trace_read(trace *t, uint32_t *pc, uint8_t *outcome);
+
+// Position of the next record trace_read() would return
+//
+void trace_tell(trace *t, trace_pos *pos);
+
+// Continue reading at a position previously returned by trace_tell() on
+// the same file. Returns 0 on success and -1 if the position is invalid or
+// the trace is not seekable (stdin).
+//
+int trace_seek(trace *t, const trace_pos *pos);
+
+// Decode .bz2 traces opened after this call on 'threads' threads, which
+// run ahead of the reader by a few blocks. 1 (the default) decodes on the
+// reading thread.
+//
+void trace_set_threads(int threads);
+
+// Non-zero if positions are bzip2 block offsets rather than byte offsets
+//
+int trace_is_bz2(trace *t);
+
+void trace_close(trace *t);
+
+#endif
@@ -0,0 +1,257 @@
+//========================================================//
+//  tracegen.c                                            //
+//  Synthetic branch trace generator                      //
+//                                                        //
+//  Builds a random "program" of static branches with a   //
+//  given PC footprint and behaviour mix, then walks it   //
+//  to emit a deterministic trace of any length in the    //
+//  text format or the binary format read by trace.c.     //
+//========================================================//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "trace.h"
+
+// Branch behaviours
+#define LOOP        0   // Taken until the loop's trip count is reached
+#define CORRELATED  1   // Repeats (or inverts) a recent global outcome
+#define BIASED      2   // Taken with a fixed, strongly skewed probability
+#define RANDOM      3   // Fair coin
+#define NUM_KINDS   4
+
+// Generator configuration
+uint64_t seed = 1;
+uint64_t numBranches = 1000000;
+uint32_t footprint = 1024;
+unsigned mix[NUM_KINDS] = { 40, 30, 20, 10 };
+int binary = 0;
+
+typedef struct {
+  uint32_t pc;
+  uint8_t kind;
+  uint8_t distance;   // CORRELATED: how many outcomes back to copy
+  uint8_t invert;     // CORRELATED: copy the inverse
+  uint32_t bias;      // BIASED: probability of taken, out of 2^32
+} static_branch;
+
+// A group of consecutive static branches executed as a loop body
+typedef struct {
+  uint32_t first;
+  uint32_t count;
+  uint32_t trip;
+} branch_group;
+
+// splitmix64, small and reproducible across platforms
+static uint64_t rngState;
+
+static uint64_t
+rng_next()
+{
+  uint64_t z = (rngState += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+static uint32_t
+rng_below(uint32_t n)
+{
+  return (uint32_t)(((rng_next() >> 32) * n) >> 32);
+}
+
+//------------------------------------//
+//           Output Buffering         //
+//------------------------------------//
+
+#define OUT_SIZE  (1 << 20)
+
+static char out[OUT_SIZE + 32];
+static size_t outLen = 0;
+
+static void
+flush_out()
+{
+  fwrite(out, 1, outLen, stdout);
+  outLen = 0;
+}
+
+static void
+emit(uint32_t pc, uint8_t outcome)
+{
+  if (binary) {
+    out[outLen++] = pc;
+    out[outLen++] = pc >> 8;
+    out[outLen++] = pc >> 16;
+    out[outLen++] = pc >> 24;
+    out[outLen++] = outcome;
+  } else {
+    static const char hex[] = "0123456789abcdef";
+    char digits[8];
+    int n = 0;
+    do {
+      digits[n++] = hex[pc & 0xf];
+      pc >>= 4;
+    } while (pc);
+
+    out[outLen++] = '0';
+    out[outLen++] = 'x';
+    while (n) {
+      out[outLen++] = digits[--n];
+    }
+    out[outLen++] = ' ';
+    out[outLen++] = '0' + outcome;
+    out[outLen++] = '\n';
+  }
+
+  if (outLen >= OUT_SIZE) {
+    flush_out();
+  }
+}
+
+//------------------------------------//
+//             Generation             //
+//------------------------------------//
+
+void
+usage()
+{
+  fprintf(stderr,"Usage: tracegen <options> > trace\n");
+  fprintf(stderr," Options:\n");
+  fprintf(stderr," --help              Print this message\n");
+  fprintf(stderr," --seed:<n>          Random seed (1)\n");
+  fprintf(stderr," --branches:<n>      Dynamic branches to emit (1000000)\n");
+  fprintf(stderr," --pcs:<n>           Distinct static branches (1024)\n");
+  fprintf(stderr," --mix:<loop>:<correlated>:<biased>:<random>\n"
+                 "                     Relative share of each behaviour\n"
+                 "                     among static branches (40:30:20:10)\n");
+  fprintf(stderr," --binary            Write the binary format instead of text\n");
+}
+
+int
+handle_option(char *arg)
+{
+  unsigned long long v;
+
+  if (!strncmp(arg,"--seed:",7) && sscanf(arg+7,"%llu",&v) == 1) {
+    seed = v;
+  } else if (!strncmp(arg,"--branches:",11) && sscanf(arg+11,"%llu",&v) == 1) {
+    numBranches = v;
+  } else if (!strncmp(arg,"--pcs:",6) && sscanf(arg+6,"%llu",&v) == 1 &&
+             v > 0 && v <= (1 << 28)) {
+    footprint = v;
+  } else if (!strncmp(arg,"--mix:",6)) {
+    if (sscanf(arg+6,"%u:%u:%u:%u", &mix[LOOP], &mix[CORRELATED],
+               &mix[BIASED], &mix[RANDOM]) != 4 ||
+        mix[LOOP] + mix[CORRELATED] + mix[BIASED] + mix[RANDOM] == 0) {
+      return 0;
+    }
+  } else if (!strcmp(arg,"--binary")) {
+    binary = 1;
+  } else {
+    return 0;
+  }
+
+  return 1;
+}
+
+int
+main(int argc, char *argv[])
+{
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i],"--help")) {
+      usage();
+      exit(0);
+    } else if (!handle_option(argv[i])) {
+      fprintf(stderr,"Unrecognized option %s\n", argv[i]);
+      usage();
+      exit(1);
+    }
+  }
+
+  rngState = seed;
+
+  // Static branches: dense, word aligned PCs like real code
+  static_branch *branches = malloc(footprint * sizeof(static_branch));
+  unsigned mixTotal = mix[LOOP] + mix[CORRELATED] + mix[BIASED] + mix[RANDOM];
+  for (uint32_t i = 0; i < footprint; i++) {
+    static_branch *b = &branches[i];
+    b->pc = 0x400000 + 8 * i + 2 * rng_below(4);
+
+    uint32_t r = rng_below(mixTotal);
+    b->kind = 0;
+    while (r >= mix[b->kind]) {
+      r -= mix[b->kind++];
+    }
+
+    b->distance = 1 + rng_below(12);
+    b->invert = rng_below(2);
+    // 90% .. 99.6% towards one direction
+    uint32_t skew = 0xe6666666u + rng_below(0x18ffffffu);
+    b->bias = rng_below(2) ? skew : ~skew;
+  }
+
+  // Cut the program into loop bodies of 1..8 branches
+  branch_group *groups = malloc(footprint * sizeof(branch_group));
+  uint32_t numGroups = 0;
+  for (uint32_t i = 0; i < footprint; numGroups++) {
+    branch_group *g = &groups[numGroups];
+    g->first = i;
+    g->count = 1 + rng_below(8);
+    if (g->count > footprint - i) {
+      g->count = footprint - i;
+    }
+    i += g->count;
+
+    // Bodies without a loop branch run straight through once
+    g->trip = 1;
+    for (uint32_t j = g->first; j < i; j++) {
+      if (branches[j].kind == LOOP) {
+        g->trip = 2 + rng_below(31);
+        break;
+      }
+    }
+  }
+
+  if (binary) {
+    memcpy(out, TRACE_BINARY_MAGIC, 8);
+    outLen = 8;
+  }
+
+  // Walk the program: pick a body, run it for its trip count, repeat
+  uint64_t history = 0;
+  uint64_t emitted = 0;
+  while (emitted < numBranches) {
+    branch_group *g = &groups[rng_below(numGroups)];
+    for (uint32_t iter = 0; iter < g->trip && emitted < numBranches; iter++) {
+      for (uint32_t j = 0; j < g->count && emitted < numBranches; j++) {
+        static_branch *b = &branches[g->first + j];
+        uint8_t outcome;
+
+        switch (b->kind) {
+          case LOOP:
+            outcome = iter + 1 < g->trip;
+            break;
+          case CORRELATED:
+            outcome = ((history >> (b->distance - 1)) & 1) ^ b->invert;
+            break;
+          case BIASED:
+            outcome = (rng_next() >> 32) < b->bias;
+            break;
+          default:
+            outcome = rng_next() >> 63;
+            break;
+        }
+
+        emit(b->pc, outcome);
+        history = (history << 1) | outcome;
+        emitted++;
+      }
+    }
+  }
+
+  flush_out();
+  free(branches);
+  free(groups);
+  return 0;
+}
@@ -0,0 +1,322 @@
+//========================================================//
+//  traceindex.c                                          //
+//  Trace index sidecar files                             //
+//                                                        //
+//  The sidecar is a small text file:                     //
+//    bpredictor-index 1                                  //
+//    size <bytes> / sample <hash> / format <plain|bz2>   //
+//    branches, distinct_pcs, taken                       //
+//    seek <branch> <offset> <skip>   (one per point)     //
+//========================================================//
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "traceindex.h"
+
+#define INDEX_VERSION  2
+
+// Bytes hashed at each end of the trace to tell regenerated traces apart
+#define SAMPLE_BYTES   (1 << 16)
+
+//------------------------------------//
+//        Distinct PC Counting        //
+//------------------------------------//
+
+// Open addressing set of PCs. 0 marks an empty slot, so PC 0 is tracked
+// separately.
+typedef struct {
+  uint32_t *slots;
+  uint64_t mask;
+  uint64_t count;
+  int hasZero;
+} pc_set;
+
+static void
+pc_set_insert(pc_set *set, uint32_t pc)
+{
+  if (pc == 0) {
+    set->count += !set->hasZero;
+    set->hasZero = 1;
+    return;
+  }
+
+  // Grow at half full
+  if (2 * (set->count + 1) > set->mask + 1) {
+    uint32_t *old = set->slots;
+    uint64_t oldSize = set->mask + 1;
+    set->mask = 2 * oldSize - 1;
+    set->slots = calloc(set->mask + 1, sizeof(uint32_t));
+    for (uint64_t i = 0; i < oldSize; i++) {
+      if (old[i]) {
+        uint64_t h = (old[i] * 0x9e3779b1u) & set->mask;
+        while (set->slots[h]) {
+          h = (h + 1) & set->mask;
+        }
+        set->slots[h] = old[i];
+      }
+    }
+    free(old);
+  }
+
+  uint64_t h = (pc * 0x9e3779b1u) & set->mask;
+  while (set->slots[h]) {
+    if (set->slots[h] == pc) {
+      return;
+    }
+    h = (h + 1) & set->mask;
+  }
+  set->slots[h] = pc;
+  set->count++;
+}
+
+//------------------------------------//
+//          Index Operations          //
+//------------------------------------//
+
+static char *
+sidecar_path(const char *path)
+{
+  char *p = malloc(strlen(path) + 5);
+  strcpy(p, path);
+  strcat(p, ".idx");
+  return p;
+}
+
+static int
+file_size(const char *path, uint64_t *size)
+{
+  struct stat st;
+  if (stat(path, &st) != 0) {
+    return -1;
+  }
+  *size = st.st_size;
+  return 0;
+}
+
+// FNV-1a hash of the first and last SAMPLE_BYTES of the 'size' byte file
+// at 'path'. Traces of the same length written by another run differ there
+// even when every record has the same width.
+static int
+file_sample(const char *path, uint64_t size, uint64_t *hash)
+{
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    return -1;
+  }
+
+  static unsigned char buf[SAMPLE_BYTES];
+  uint64_t h = 0xcbf29ce484222325ULL;
+  for (int end = 0; end < 2; end++) {
+    uint64_t start = end && size > SAMPLE_BYTES ? size - SAMPLE_BYTES : 0;
+    size_t n = size < SAMPLE_BYTES ? size : SAMPLE_BYTES;
+    if (fseeko(f, start, SEEK_SET) != 0 || fread(buf, 1, n, f) != n) {
+      fclose(f);
+      return -1;
+    }
+    for (size_t i = 0; i < n; i++) {
+      h = (h ^ buf[i]) * 0x100000001b3ULL;
+    }
+  }
+
+  fclose(f);
+  *hash = h;
+  return 0;
+}
+
+static void
+add_seek(trace_index *idx, uint64_t *cap, uint64_t branch,
+         const trace_pos *pos)
+{
+  if (idx->numSeeks == *cap) {
+    *cap = *cap ? *cap * 2 : 64;
+    idx->seeks = realloc(idx->seeks, *cap * sizeof(trace_seek_point));
+  }
+  idx->seeks[idx->numSeeks].branch = branch;
+  idx->seeks[idx->numSeeks].pos = *pos;
+  idx->numSeeks++;
+}
+
+int
+trace_index_build(const char *path, uint64_t interval, trace_index *idx)
+{
+  memset(idx, 0, sizeof(*idx));
+  if (file_size(path, &idx->fileSize) != 0 ||
+      file_sample(path, idx->fileSize, &idx->sample) != 0) {
+    fprintf(stderr, "index: cannot read %s\n", path);
+    return -1;
+  }
+
+  trace *t = trace_open(path);
+  if (!t) {
+    return -1;
+  }
+  idx->bz2 = trace_is_bz2(t);
+
+  pc_set pcs;
+  pcs.mask = (1 << 10) - 1;
+  pcs.slots = calloc(pcs.mask + 1, sizeof(uint32_t));
+  pcs.count = 0;
+  pcs.hasZero = 0;
+
+  uint64_t cap = 0;
+  uint64_t lastSeek = 0;
+  uint64_t lastBlock = UINT64_MAX;
+  trace_pos pos;
+  uint32_t pc;
+  uint8_t outcome;
+
+  trace_tell(t, &pos);
+  while (trace_read(t, &pc, &outcome)) {
+    // pos is where this branch started. For .bz2 only the first branch that
+    // starts in a new block is a candidate.
+    int candidate = idx->bz2 ? pos.offset != lastBlock : 1;
+    if (idx->numSeeks == 0 ||
+        (candidate && idx->branches - lastSeek >= interval)) {
+      add_seek(idx, &cap, idx->branches, &pos);
+      lastSeek = idx->branches;
+    }
+    lastBlock = pos.offset;
+
+    idx->branches++;
+    idx->taken += outcome != 0;
+    pc_set_insert(&pcs, pc);
+    trace_tell(t, &pos);
+  }
+
+  idx->distinctPcs = pcs.count;
+  free(pcs.slots);
+  trace_close(t);
+  return 0;
+}
+
+int
+trace_index_write(const char *path, const trace_index *idx)
+{
+  char *name = sidecar_path(path);
+  FILE *f = fopen(name, "w");
+  if (!f) {
+    fprintf(stderr, "index: cannot write %s\n", name);
+    free(name);
+    return -1;
+  }
+
+  fprintf(f, "bpredictor-index %d\n", INDEX_VERSION);
+  fprintf(f, "size %llu\n", (unsigned long long)idx->fileSize);
+  fprintf(f, "sample %016llx\n", (unsigned long long)idx->sample);
+  fprintf(f, "format %s\n", idx->bz2 ? "bz2" : "plain");
+  fprintf(f, "branches %llu\n", (unsigned long long)idx->branches);
+  fprintf(f, "distinct_pcs %llu\n", (unsigned long long)idx->distinctPcs);
+  fprintf(f, "taken %llu\n", (unsigned long long)idx->taken);
+  for (uint64_t i = 0; i < idx->numSeeks; i++) {
+    fprintf(f, "seek %llu %llu %u\n",
+            (unsigned long long)idx->seeks[i].branch,
+            (unsigned long long)idx->seeks[i].pos.offset,
+            idx->seeks[i].pos.skip);
+  }
+
+  int ok = fclose(f) == 0;
+  free(name);
+  return ok ? 0 : -1;
+}
+
+int
+trace_index_load(const char *path, trace_index *idx)
+{
+  memset(idx, 0, sizeof(*idx));
+
+  char *name = sidecar_path(path);
+  FILE *f = fopen(name, "r");
+  free(name);
+  if (!f) {
+    return -1;
+  }
+
+  int version = 0;
+  char format[16] = "";
+  unsigned long long size = 0, sample = 0, branches = 0, distinct = 0, taken = 0;
+  int ok = fscanf(f, "bpredictor-index %d size %llu sample %llx format %15s "
+                     "branches %llu distinct_pcs %llu taken %llu", &version,
+                  &size, &sample, format, &branches, &distinct, &taken) == 7 &&
+           version == INDEX_VERSION;
+
+  // Same length is not enough, a regenerated trace often has it too
+  uint64_t actual, actualSample;
+  if (!ok || file_size(path, &actual) != 0 || actual != size ||
+      file_sample(path, actual, &actualSample) != 0 ||
+      actualSample != sample) {
+    fclose(f);
+    return -1;
+  }
+
+  idx->fileSize = size;
+  idx->sample = sample;
+  idx->bz2 = !strcmp(format, "bz2");
+  idx->branches = branches;
+  idx->distinctPcs = distinct;
+  idx->taken = taken;
+
+  uint64_t cap = 0;
+  unsigned long long branch, offset;
+  unsigned skip;
+  while (fscanf(f, " seek %llu %llu %u", &branch, &offset, &skip) == 3) {
+    trace_pos pos = { offset, skip };
+    add_seek(idx, &cap, branch, &pos);
+  }
+
+  fclose(f);
+  return 0;
+}
+
+int
+trace_index_seek(trace *t, const trace_index *idx, uint64_t branch)
+{
+  if (idx->numSeeks == 0 || idx->bz2 != trace_is_bz2(t)) {
+    return -1;
+  }
+
+  // Last seek point at or before the branch
+  uint64_t lo = 0, hi = idx->numSeeks;
+  while (hi - lo > 1) {
+    uint64_t mid = (lo + hi) / 2;
+    if (idx->seeks[mid].branch <= branch) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+
+  if (trace_seek(t, &idx->seeks[lo].pos) != 0) {
+    return -1;
+  }
+
+  uint32_t pc;
+  uint8_t outcome;
+  // Past the end just leaves the trace exhausted, like reading through it
+  for (uint64_t i = idx->seeks[lo].branch; i < branch; i++) {
+    if (!trace_read(t, &pc, &outcome)) {
+      break;
+    }
+  }
+  return 0;
+}
+
+void
+trace_index_print(FILE *out, const trace_index *idx)
+{
+  fprintf(out, "Branches:        %10llu\n", (unsigned long long)idx->branches);
+  fprintf(out, "Distinct PCs:    %10llu\n", (unsigned long long)idx->distinctPcs);
+  fprintf(out, "Taken Ratio:        %7.3f\n",
+          idx->branches ? 100.0 * idx->taken / idx->branches : 0.0);
+  fprintf(out, "Seek Points:     %10llu (%s)\n",
+          (unsigned long long)idx->numSeeks,
+          idx->bz2 ? "bzip2 blocks" : "byte offsets");
+}
+
+void
+trace_index_free(trace_index *idx)
+{
+  free(idx->seeks);
+  idx->seeks = NULL;
+  idx->numSeeks = 0;
+}
@@ -0,0 +1,60 @@
+//========================================================//
+//  traceindex.h                                          //
+//  Trace index sidecar files                             //
+//                                                        //
+//  One pass over a trace records its length, PC          //
+//  footprint, taken ratio and periodic seek points in    //
+//  "<trace>.idx" so later runs can size structures up    //
+//  front and start at any branch.                        //
+//========================================================//
+
+#ifndef TRACEINDEX_H
+#define TRACEINDEX_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "trace.h"
+
+// Default number of branches between seek points
+#define INDEX_INTERVAL  (1 << 16)
+
+typedef struct {
+  uint64_t branch;  // Number of the first branch read from 'pos'
+  trace_pos pos;
+} trace_seek_point;
+
+typedef struct {
+  uint64_t fileSize;      // Size of the trace the index was built from
+  uint64_t sample;        // Hash of its first and last 64 KiB
+  int bz2;                // Seek offsets are bzip2 block bit offsets
+  uint64_t branches;
+  uint64_t distinctPcs;
+  uint64_t taken;
+  uint64_t numSeeks;
+  trace_seek_point *seeks;
+} trace_index;
+
+// Read the whole trace at 'path' and fill in 'idx', with a seek point at
+// least every 'interval' branches (at block starts for .bz2 traces).
+// Returns 0 on success.
+//
+int trace_index_build(const char *path, uint64_t interval, trace_index *idx);
+
+// Write / read the sidecar of 'path'. Loading fails (-1) if there is no
+// sidecar or it was built for a different version of the trace.
+//
+int trace_index_write(const char *path, const trace_index *idx);
+int trace_index_load(const char *path, trace_index *idx);
+
+// Position 't' so the next trace_read() returns branch number 'branch'
+// (0-based), using the nearest preceding seek point. Returns 0 on success.
+//
+int trace_index_seek(trace *t, const trace_index *idx, uint64_t branch);
+
+// Print a one-screen summary of the index
+//
+void trace_index_print(FILE *out, const trace_index *idx);
+
+void trace_index_free(trace_index *idx);
+
+#endif